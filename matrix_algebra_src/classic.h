@@ -1,6 +1,11 @@
 #pragma once
 
 #include "definition.h"
+#include "dispatch.h"
+#include "gemm/gemm.h"
+#include "gemm/transpose.h"
+#include "parallel/async.h"
+#include "parallel/elementwise.h"
 
 namespace maykitbo {
 
@@ -10,13 +15,16 @@ void Matrix<T>::Algebra::Sum(const Matrix &a, const T value, Matrix &c)
     if (a.rows_ != c.rows_ || a.cols_ != c.cols_)
         throw std::runtime_error("Algebra::Sum: different sizes");
 
-    const T *a_data = a.Data();
-    T *c_data = c.Data();
-    unsigned size = a.rows_ * a.cols_;
-    for (i_type k = 0; k < size; ++k)
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    const T *x = a.Data();
+    T *z = c.Data();
+    // In place the result is cached already, streaming it would not pay
+    const std::size_t bytes = z == x ? 0 : std::size_t(a.rows_) * a.cols_ * sizeof(T);
+    parallel::Elementwise(a.rows_ * a.cols_, bytes,
+                          [&](unsigned from, unsigned to, bool stream)
     {
-        c_data[k] = a_data[k] + value;
-    }
+        (stream ? K.add_scalar_stream : K.add_scalar)(to - from, x + from, value, z + from);
+    });
 }
 
 template <class T>
@@ -25,13 +33,15 @@ void Matrix<T>::Algebra::Mul(const Matrix &a, const T value, Matrix &c)
     if (a.rows_ != c.rows_ || a.cols_ != c.cols_)
         throw std::runtime_error("Algebra::Mul: different sizes");
 
-    const T *a_data = a.Data();
-    T *c_data = c.Data();
-    unsigned size = a.rows_ * a.cols_;
-    for (i_type k = 0; k < size; ++k)
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    const T *x = a.Data();
+    T *z = c.Data();
+    const std::size_t bytes = z == x ? 0 : std::size_t(a.rows_) * a.cols_ * sizeof(T);
+    parallel::Elementwise(a.rows_ * a.cols_, bytes,
+                          [&](unsigned from, unsigned to, bool stream)
     {
-        c_data[k] = a_data[k] * value;
-    }
+        (stream ? K.scale_stream : K.scale)(to - from, x + from, value, z + from);
+    });
 }
 
 template <class T>
@@ -40,22 +50,15 @@ void Matrix<T>::Algebra::Sum(const Matrix &a, const Matrix &b, Matrix &c)
     if (a.rows_ != b.rows_ || a.cols_ != b.cols_ || a.rows_ != c.rows_ || a.cols_ != c.cols_)
         throw std::runtime_error("Algebra::Sum: different sizes");
 
-    const T *a_data = a.Data();
-    const T *b_data = b.Data();
-    T *c_data = c.Data();
-    unsigned size = a.rows_ * a.cols_;
-    // for (i_type i = 0; i < a.rows_; ++i)
-    // {
-    //     for (i_type j = 0; j < a.cols_; ++j)
-    //     {
-    //         c_data[i * a.cols_ + j] =
-    //             a_data[i * a.cols_ + j] + b_data[i * a.cols_ + j];
-    //     }
-    // }
-    for (i_type k = 0; k < size; ++k)
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    const T *x = a.Data(), *y = b.Data();
+    T *z = c.Data();
+    const std::size_t bytes = z == x || z == y ? 0 : std::size_t(a.rows_) * a.cols_ * sizeof(T);
+    parallel::Elementwise(a.rows_ * a.cols_, bytes,
+                          [&](unsigned from, unsigned to, bool stream)
     {
-        c_data[k] = a_data[k] + b_data[k];
-    }
+        (stream ? K.add_stream : K.add)(to - from, x + from, y + from, z + from);
+    });
 }
 
 
@@ -65,21 +68,15 @@ void Matrix<T>::Algebra::Sub(const Matrix &a, const Matrix &b, Matrix &c)
     if (a.rows_ != b.rows_ || a.cols_ != b.cols_ || a.rows_ != c.rows_ || a.cols_ != c.cols_)
         throw std::runtime_error("Algebra::Sub: different sizes");
 
-    const T *a_data = a.Data();
-    const T *b_data = b.Data();
-    T *c_data = c.Data();
-    unsigned size = a.rows_ * a.cols_;
-    // for (i_type i = 0; i < a.rows_; ++i) {
-    //     for (i_type j = 0; j < a.cols_; ++j)
-    //     {
-    //         c_data[i * a.cols_ + j] =
-    //             a_data[i * a.cols_ + j] - b_data[i * a.cols_ + j];
-    //     }
-    // }
-    for (i_type k = 0; k < size; ++k)
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    const T *x = a.Data(), *y = b.Data();
+    T *z = c.Data();
+    const std::size_t bytes = z == x || z == y ? 0 : std::size_t(a.rows_) * a.cols_ * sizeof(T);
+    parallel::Elementwise(a.rows_ * a.cols_, bytes,
+                          [&](unsigned from, unsigned to, bool stream)
     {
-        c_data[k] = a_data[k] - b_data[k];
-    }
+        (stream ? K.sub_stream : K.sub)(to - from, x + from, y + from, z + from);
+    });
 }
 
 template <class T>
@@ -87,12 +84,59 @@ void Matrix<T>::Algebra::Mul(const Matrix &a, const Matrix &b, Matrix &c)
 {
     if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
         throw std::runtime_error("Algebra::Mul: different sizes");
+    if (&c == &a || &c == &b)
+    {
+        Matrix result(c.rows_, c.cols_);
+        Mul(a, b, result);
+        c = std::move(result);
+        return;
+    }
+
+    DispatchMul(a, b, c);
+}
+
+template <class T>
+std::future<MulAlgorithm> Matrix<T>::Algebra::MulAsync(const Matrix &a, const Matrix &b, Matrix &c)
+{
+    if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
+        throw std::runtime_error("Algebra::MulAsync: different sizes");
+
+    return parallel::Async([&a, &b, &c]
+    {
+        Mul(a, b, c);
+        return LastMul();
+    });
+}
+
+template <class T>
+void Matrix<T>::Algebra::MulAsync(const Matrix &a, const Matrix &b, Matrix &c,
+                                  std::function<void(std::exception_ptr)> done)
+{
+    if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
+        throw std::runtime_error("Algebra::MulAsync: different sizes");
+
+    parallel::Async([&a, &b, &c] { Mul(a, b, c); }, std::move(done));
+}
+
+template <class T>
+void Matrix<T>::Algebra::MulClassic(const Matrix &a, const Matrix &b, Matrix &c)
+{
+    if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
+        throw std::runtime_error("Algebra::MulClassic: different sizes");
+    if (&c == &a || &c == &b)
+    {
+        Matrix result(c.rows_, c.cols_);
+        MulClassic(a, b, result);
+        c = std::move(result);
+        return;
+    }
 
     const T *a_data = a.Data();
     const T *b_data = b.Data();
     T *c_data = c.Data();
     for (i_type i = 0; i < a.rows_; ++i)
     {
+        parallel::CheckCancel();
         for (i_type j = 0; j < b.cols_; ++j)
         {
             T sum = 0;
@@ -105,6 +149,44 @@ void Matrix<T>::Algebra::Mul(const Matrix &a, const Matrix &b, Matrix &c)
     }
 }
 
+template <class T>
+void Matrix<T>::Algebra::MulBlocked(const Matrix &a, const Matrix &b, Matrix &c)
+{
+    if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
+        throw std::runtime_error("Algebra::Mul: different sizes");
+    if (&c == &a || &c == &b)
+    {
+        Matrix result(c.rows_, c.cols_);
+        MulBlocked(a, b, result);
+        c = std::move(result);
+        return;
+    }
+
+    Gemm<T>::Mul(a.rows_, b.cols_, a.cols_,
+                 a.Data(), a.cols_,
+                 b.Data(), b.cols_,
+                 c.Data(), c.cols_);
+}
+
+template <class T>
+void Matrix<T>::Algebra::MulParallel(const Matrix &a, const Matrix &b, Matrix &c)
+{
+    if (a.cols_ != b.rows_ || a.rows_ != c.rows_ || b.cols_ != c.cols_)
+        throw std::runtime_error("Algebra::MulParallel: different sizes");
+    if (&c == &a || &c == &b)
+    {
+        Matrix result(c.rows_, c.cols_);
+        MulParallel(a, b, result);
+        c = std::move(result);
+        return;
+    }
+
+    Gemm<T>::MulParallel(a.rows_, b.cols_, a.cols_,
+                         a.Data(), a.cols_,
+                         b.Data(), b.cols_,
+                         c.Data(), c.cols_);
+}
+
 template <class T>
 void Matrix<T>::Algebra::MulABT(const Matrix &a, const Matrix &b, Matrix &c)
 {
@@ -252,14 +334,24 @@ template <class T>
 Matrix<T> Matrix<T>::Algebra::Transpose(const Matrix &a)
 {
     Matrix<T> transpose(a.cols_, a.rows_);
-    for (int i = 0; i < a.rows_; i++)
+    Transpose(a, transpose);
+    return transpose;
+}
+
+template <class T>
+void Matrix<T>::Algebra::Transpose(const Matrix &a, Matrix &c)
+{
+    if (a.rows_ != c.cols_ || a.cols_ != c.rows_)
+        throw std::runtime_error("Algebra::Transpose: different sizes");
+    if (&c == &a)
     {
-        for (int j = 0; j < a.cols_; j++)
-        {
-            transpose(j, i) = a(i, j);
-        }
+        Matrix result(c.rows_, c.cols_);
+        Transpose(a, result);
+        c = std::move(result);
+        return;
     }
-    return transpose;
+
+    Transposition<T>::RunParallel(a.rows_, a.cols_, a.Data(), a.cols_, c.Data(), c.cols_);
 }
 
 
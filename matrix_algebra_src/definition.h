@@ -2,8 +2,15 @@
 
 #include "../matrix.h"
 
+#include <exception>
+#include <functional>
+#include <future>
+
 namespace maykitbo {
 
+// See dispatch.h
+enum class MulAlgorithm;
+
 template<class T>
 class Matrix<T>::Algebra
 {
@@ -20,8 +27,24 @@ class Matrix<T>::Algebra
         static T Determinant(const Matrix &a);
         static Matrix Minor(const Matrix &a, int row, int col);
         static Matrix Transpose(const Matrix &a);
+        // c = a^T without allocating, see Transposition
+        static void Transpose(const Matrix &a, Matrix &c);
 
+        // Runs the algorithm SelectMul picks, see dispatch.h. The products
+        // throw parallel::Cancelled once the token of their CancelScope stops.
         static void Mul(const Matrix &a, const Matrix &b, Matrix &c);
+        static void MulClassic(const Matrix &a, const Matrix &b, Matrix &c);
+        static void MulBlocked(const Matrix &a, const Matrix &b, Matrix &c);
+        // MulBlocked over 2D tiles of c on the thread budget, see
+        // Gemm::MulParallel
+        static void MulParallel(const Matrix &a, const Matrix &b, Matrix &c);
+        // Mul on the shared pool, see parallel::Async: sizes are checked
+        // at once, a, b and c must live until the product is done. The
+        // future gives the algorithm the product ran, which LastMul of the
+        // calling thread does not see.
+        static std::future<MulAlgorithm> MulAsync(const Matrix &a, const Matrix &b, Matrix &c);
+        static void MulAsync(const Matrix &a, const Matrix &b, Matrix &c,
+                             std::function<void(std::exception_ptr)> done);
 
 };
 
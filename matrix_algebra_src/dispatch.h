@@ -0,0 +1,191 @@
+#pragma once
+
+#include "definition.h"
+#include "strassen_winograd/strassen_parallel.h"
+#include "strassen_winograd/winograd_parallel.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+namespace maykitbo {
+
+// Algorithm behind Algebra::Mul and operator*.
+//
+//  Auto       chosen per product by SelectMul
+//  Classic    the i-j-k loop
+//  Blocked    the packed SIMD Gemm, over 2D tiles on the thread budget
+//  Winograd, WinogradP, Strassen, StrassenP
+//             the recursive engines with their Tuned caps
+enum class MulAlgorithm { Auto, Classic, Blocked, Winograd, WinogradP, Strassen, StrassenP };
+
+inline const char *MulAlgorithmName(MulAlgorithm algorithm) noexcept
+{
+    switch (algorithm)
+    {
+        case MulAlgorithm::Auto: return "auto";
+        case MulAlgorithm::Classic: return "classic";
+        case MulAlgorithm::Blocked: return "blocked";
+        case MulAlgorithm::Winograd: return "winograd";
+        case MulAlgorithm::WinogradP: return "winogradp";
+        case MulAlgorithm::Strassen: return "strassen";
+        case MulAlgorithm::StrassenP: return "strassenp";
+    }
+    return "unknown";
+}
+
+namespace detail {
+
+// Pinned at startup: Auto, or MAYKITBO_MUL=classic|blocked|winograd|...
+inline MulAlgorithm StartupMul() noexcept
+{
+    const char *env = std::getenv("MAYKITBO_MUL");
+    if (env == nullptr)
+        return MulAlgorithm::Auto;
+    for (MulAlgorithm algorithm : {MulAlgorithm::Classic, MulAlgorithm::Blocked,
+                                   MulAlgorithm::Winograd, MulAlgorithm::WinogradP,
+                                   MulAlgorithm::Strassen, MulAlgorithm::StrassenP})
+    {
+        if (std::strcmp(env, MulAlgorithmName(algorithm)) == 0)
+            return algorithm;
+    }
+    return MulAlgorithm::Auto;
+}
+
+inline std::atomic<MulAlgorithm> &PinnedMul() noexcept
+{
+    static std::atomic<MulAlgorithm> pinned{StartupMul()};
+    return pinned;
+}
+
+inline MulAlgorithm &LastMul() noexcept
+{
+    thread_local MulAlgorithm last = MulAlgorithm::Auto;
+    return last;
+}
+
+} // namespace detail
+
+// Algorithm every product runs, Auto when SelectMul decides
+inline MulAlgorithm PinnedMul() noexcept
+{
+    return detail::PinnedMul().load(std::memory_order_relaxed);
+}
+
+// Pins every product to algorithm, Auto unpins
+inline void PinMul(MulAlgorithm algorithm) noexcept
+{
+    detail::PinnedMul().store(algorithm, std::memory_order_relaxed);
+}
+
+// Threads a product may use, at least 1: parallel::Threads, the scoped
+// ThreadBudget or else the process-wide one
+inline unsigned MulThreads() noexcept
+{
+    return parallel::Threads();
+}
+
+// 0 restores the CPUs the affinity mask and cgroup quota allow
+inline void SetMulThreads(unsigned threads) noexcept
+{
+    parallel::SetThreads(threads);
+}
+
+// Algorithm of the last Algebra::Mul or operator* this thread ran itself,
+// Auto before any. MulAsync runs Mul on a worker and returns its algorithm
+// through the future instead.
+inline MulAlgorithm LastMul() noexcept
+{
+    return detail::LastMul();
+}
+
+namespace detail {
+
+// Cap a recursive engine runs with by default: up to a smallest
+// dimension of cap + 1 it would not run a level
+template<class T>
+unsigned EngineCap(MulAlgorithm algorithm)
+{
+    const Thresholds &t = Tuned<T>();
+    switch (algorithm)
+    {
+        case MulAlgorithm::Winograd: return t.winograd_cap;
+        case MulAlgorithm::WinogradP: return t.winogradp_cap;
+        case MulAlgorithm::Strassen:
+        case MulAlgorithm::StrassenP: return t.strassen_cap;
+        default: return 0;
+    }
+}
+
+} // namespace detail
+
+// Algorithm an m x k by k x n product of T runs: the pinned one, else
+//
+//  Classic    up to 16^3 multiply-adds, where packing does not pay
+//  Blocked    for floating point, which the fast engines would round
+//             differently (pin one or use Stable, see stability.h); for
+//             other types while the smallest dimension is within the
+//             Tuned cap, so Winograd would not run a level, and with a
+//             thread budget of 2 or more up to Tuned parallel_min, where
+//             its tiles balance better than seven products
+//  Winograd   for other types beyond, exact and with fewer additions,
+//             WinogradP with a thread budget of 2 or more
+//
+// A pinned recursive engine gives way to Blocked on the shapes it would
+// not run a level of, vectors among them.
+template<class T>
+MulAlgorithm SelectMul(unsigned m, unsigned k, unsigned n)
+{
+    const unsigned lo = std::min({m, k, n});
+    const MulAlgorithm pinned = PinnedMul();
+    if (pinned != MulAlgorithm::Auto)
+    {
+        const bool recursive = pinned != MulAlgorithm::Classic && pinned != MulAlgorithm::Blocked;
+        return recursive && lo <= detail::EngineCap<T>(pinned) + 1 ? MulAlgorithm::Blocked : pinned;
+    }
+
+    const Thresholds t = Tuned<T>();
+    if (double(m) * k * n <= 16 * 16 * 16)
+        return MulAlgorithm::Classic;
+    const bool parallel = MulThreads() > 1;
+    if (std::is_floating_point_v<T> || lo <= t.winograd_cap + 1 ||
+        (parallel && lo <= t.parallel_min))
+        return MulAlgorithm::Blocked;
+    return parallel ? MulAlgorithm::WinogradP : MulAlgorithm::Winograd;
+}
+
+// Runs c = a * b with the selected algorithm and records it for
+// LastMul; sizes are checked and c aliases neither operand
+template<class T>
+MulAlgorithm DispatchMul(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c)
+{
+    const unsigned m = a.GetRows(), k = a.GetCols(), n = b.GetCols();
+    const MulAlgorithm algorithm = SelectMul<T>(m, k, n);
+    switch (algorithm)
+    {
+        case MulAlgorithm::Auto:
+        case MulAlgorithm::Classic:
+            Matrix<T>::Algebra::MulClassic(a, b, c);
+            break;
+        case MulAlgorithm::Blocked:
+            Gemm<T>::MulParallel(m, n, k, a.Data(), k, b.Data(), n, c.Data(), n);
+            break;
+        case MulAlgorithm::Winograd:
+            Winograd<T>::Mul(a, b, c);
+            break;
+        case MulAlgorithm::WinogradP:
+            WinogradP<T>::Mul(a, b, c);
+            break;
+        case MulAlgorithm::Strassen:
+            Strassen<T>::Mul(a, b, c);
+            break;
+        case MulAlgorithm::StrassenP:
+            StrassenP<T>::Mul(a, b, c);
+            break;
+    }
+    detail::LastMul() = algorithm == MulAlgorithm::Auto ? MulAlgorithm::Classic : algorithm;
+    return detail::LastMul();
+}
+
+} // namespace maykitbo
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "../parallel/thread_pool.h"
+#include "../simd/kernels.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace maykitbo {
+
+// Cache-blocked, packed matrix multiplication in the GotoBLAS/BLIS style.
+//
+//  C (m x n) = A (m x k) * B (k x n), all row-major with leading dimensions.
+//
+//  jc loop: NC columns of B    -> packed B panel lives in L3
+//  pc loop: KC depth           -> packed A block lives in L2
+//  ic loop: MC rows of A
+//  jr loop: NR columns         -> B micro-panel lives in L1
+//  ir loop: MR rows            -> MR x NR accumulators live in registers
+template<class T>
+class Gemm
+{
+    public:
+        using i_type = unsigned;
+
+        // kc, packed A micro-panel (MR x kc), packed B micro-panel (kc x NR),
+        // C tile, ldc, accumulate into C instead of overwriting it
+        using kernel_t = void (*)(i_type, const T *, const T *, T *, i_type, bool);
+
+        struct Kernel
+        {
+            i_type mr, nr;
+            kernel_t run;
+        };
+
+        struct Blocking
+        {
+            i_type mc, kc, nc;
+        };
+
+        // Tile of C one task of MulParallel computes
+        struct Tiling
+        {
+            i_type rows, cols;
+        };
+
+        static void Mul(i_type m, i_type n, i_type k,
+                        const T *A, i_type lda,
+                        const T *B, i_type ldb,
+                        T *C, i_type ldc,
+                        bool accumulate = false);
+
+        // Mul over 2D tiles of C, stealable tasks on the pool of the thread
+        // budget (parallel::Threads); on the calling thread for a budget
+        // of 1 or a product too small to split
+        static void MulParallel(i_type m, i_type n, i_type k,
+                                const T *A, i_type lda,
+                                const T *B, i_type ldb,
+                                T *C, i_type ldc,
+                                bool accumulate = false);
+
+        // Microkernel of the active instruction set, see simd::ActiveIsa
+        static Kernel GetKernel();
+        static Blocking GetBlocking(const Kernel &kernel);
+        // Tiles of an m x n C for threads: mc rows by up to nc columns,
+        // halved, columns first, down to the register tile until there
+        // are four tiles a thread
+        static Tiling GetTiling(const Kernel &kernel, i_type m, i_type n, unsigned threads);
+
+        // Products below this many multiply-adds skip packing entirely
+        static constexpr unsigned long small_cap = 24 * 24 * 24;
+        static constexpr i_type max_tile = 16 * 32;
+
+    private:
+        static void Small(i_type m, i_type n, i_type k,
+                          const T *A, i_type lda, const T *B, i_type ldb,
+                          T *C, i_type ldc, bool accumulate);
+        static void PackA(i_type mc, i_type kc, const T *A, i_type lda, i_type mr, T *buf);
+        static void PackB(i_type kc, i_type nc, const T *B, i_type ldb, i_type nr, T *buf);
+        static void MacroKernel(const Kernel &kernel, i_type mc, i_type nc, i_type kc,
+                                const T *a, const T *b, T *C, i_type ldc, bool accumulate);
+};
+
+template<class T>
+typename Gemm<T>::Blocking Gemm<T>::GetBlocking(const Kernel &kernel)
+{
+    static const std::size_t l1 = simd::CacheSize(1), l2 = simd::CacheSize(2),
+                             l3 = simd::CacheSize(3);
+
+    // Half of L1 holds a B micro-panel, half of L2 the packed A block,
+    // half of L3 the packed B panel; the rest is left for C and streaming.
+    i_type kc = std::clamp<std::size_t>(l1 / 2 / (kernel.nr * sizeof(T)), 64, 512);
+    i_type mc = std::clamp<std::size_t>(l2 / 2 / (kc * sizeof(T)), kernel.mr, 1024);
+    i_type nc = std::clamp<std::size_t>(l3 / 2 / (kc * sizeof(T)), kernel.nr, 8192);
+    mc -= mc % kernel.mr;
+    nc -= nc % kernel.nr;
+    return Blocking{mc, kc, nc};
+}
+
+template<class T>
+typename Gemm<T>::Kernel Gemm<T>::GetKernel()
+{
+    const simd::Kernels<T> &k = simd::Kernels<T>::Get();
+    return Kernel{k.mr, k.nr, k.gemm};
+}
+
+template<class T>
+void Gemm<T>::Small(i_type m, i_type n, i_type k,
+                    const T *A, i_type lda, const T *B, i_type ldb,
+                    T *C, i_type ldc, bool accumulate)
+{
+    for (i_type i = 0; i < m; ++i)
+    {
+        T *ci = C + i * ldc;
+        if (!accumulate)
+            std::fill(ci, ci + n, T());
+        for (i_type p = 0; p < k; ++p)
+        {
+            const T aip = A[i * lda + p];
+            const T *bp = B + p * ldb;
+            for (i_type j = 0; j < n; ++j)
+            {
+                ci[j] += aip * bp[j];
+            }
+        }
+    }
+}
+
+template<class T>
+void Gemm<T>::PackA(i_type mc, i_type kc, const T *A, i_type lda, i_type mr, T *buf)
+{
+    for (i_type ir = 0; ir < mc; ir += mr)
+    {
+        const i_type rows = std::min(mr, mc - ir);
+        for (i_type p = 0; p < kc; ++p)
+        {
+            i_type i = 0;
+            for (; i < rows; ++i)
+                *buf++ = A[(ir + i) * lda + p];
+            for (; i < mr; ++i)
+                *buf++ = T();
+        }
+    }
+}
+
+template<class T>
+void Gemm<T>::PackB(i_type kc, i_type nc, const T *B, i_type ldb, i_type nr, T *buf)
+{
+    for (i_type jr = 0; jr < nc; jr += nr)
+    {
+        const i_type cols = std::min(nr, nc - jr);
+        for (i_type p = 0; p < kc; ++p)
+        {
+            const T *bp = B + p * ldb + jr;
+            i_type j = 0;
+            for (; j < cols; ++j)
+                *buf++ = bp[j];
+            for (; j < nr; ++j)
+                *buf++ = T();
+        }
+    }
+}
+
+template<class T>
+void Gemm<T>::MacroKernel(const Kernel &kernel, i_type mc, i_type nc, i_type kc,
+                          const T *a, const T *b, T *C, i_type ldc, bool accumulate)
+{
+    const i_type mr = kernel.mr, nr = kernel.nr;
+    T tile[max_tile];
+
+    for (i_type jr = 0; jr < nc; jr += nr)
+    {
+        const i_type cols = std::min(nr, nc - jr);
+        const T *bp = b + jr * kc;
+        for (i_type ir = 0; ir < mc; ir += mr)
+        {
+            const i_type rows = std::min(mr, mc - ir);
+            const T *ap = a + ir * kc;
+            T *c = C + ir * ldc + jr;
+            if (rows == mr && cols == nr)
+            {
+                kernel.run(kc, ap, bp, c, ldc, accumulate);
+                continue;
+            }
+            // Edge tile: compute the full register tile aside and copy back
+            // only the part that lies inside C.
+            kernel.run(kc, ap, bp, tile, nr, false);
+            for (i_type i = 0; i < rows; ++i)
+            {
+                for (i_type j = 0; j < cols; ++j)
+                {
+                    T &cij = c[i * ldc + j];
+                    cij = accumulate ? cij + tile[i * nr + j] : tile[i * nr + j];
+                }
+            }
+        }
+    }
+}
+
+template<class T>
+void Gemm<T>::Mul(i_type m, i_type n, i_type k,
+                  const T *A, i_type lda,
+                  const T *B, i_type ldb,
+                  T *C, i_type ldc,
+                  bool accumulate)
+{
+    if (m == 0 || n == 0)
+        return;
+    const Kernel kernel = GetKernel();
+    // Thinner than one register tile (a GEMV-like border) packing would
+    // copy a whole operand to use it once
+    if ((unsigned long)m * n * k <= small_cap || k == 0 || m < kernel.mr || n < kernel.nr)
+    {
+        Small(m, n, k, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    const Blocking blk = GetBlocking(kernel);
+
+    thread_local std::vector<T> a_pack, b_pack;
+    const i_type kc_max = std::min(blk.kc, k);
+    const i_type mc_max = std::min(blk.mc, m + kernel.mr - 1) / kernel.mr * kernel.mr;
+    const i_type nc_max = std::min(blk.nc, n + kernel.nr - 1) / kernel.nr * kernel.nr;
+    if (a_pack.size() < (std::size_t)mc_max * kc_max)
+        a_pack.resize((std::size_t)mc_max * kc_max);
+    if (b_pack.size() < (std::size_t)kc_max * nc_max)
+        b_pack.resize((std::size_t)kc_max * nc_max);
+
+    for (i_type jc = 0; jc < n; jc += blk.nc)
+    {
+        const i_type nc = std::min(blk.nc, n - jc);
+        for (i_type pc = 0; pc < k; pc += blk.kc)
+        {
+            const i_type kc = std::min(blk.kc, k - pc);
+            const bool acc = accumulate || pc != 0;
+            parallel::CheckCancel();
+            PackB(kc, nc, B + pc * ldb + jc, ldb, kernel.nr, b_pack.data());
+            for (i_type ic = 0; ic < m; ic += blk.mc)
+            {
+                const i_type mc = std::min(blk.mc, m - ic);
+                PackA(mc, kc, A + ic * lda + pc, lda, kernel.mr, a_pack.data());
+                MacroKernel(kernel, mc, nc, kc, a_pack.data(), b_pack.data(),
+                            C + ic * ldc + jc, ldc, acc);
+            }
+        }
+    }
+}
+
+template<class T>
+typename Gemm<T>::Tiling Gemm<T>::GetTiling(const Kernel &kernel, i_type m, i_type n,
+                                            unsigned threads)
+{
+    const Blocking blk = GetBlocking(kernel);
+    auto round = [](i_type size, i_type step) { return (size + step - 1) / step * step; };
+    Tiling tile{std::min(blk.mc, round(m, kernel.mr)), std::min(blk.nc, round(n, kernel.nr))};
+    auto count = [&]
+    {
+        return std::size_t((m + tile.rows - 1) / tile.rows) * ((n + tile.cols - 1) / tile.cols);
+    };
+    // Narrower tiles repack A less often than shorter ones repack B
+    while (count() < 4 * std::size_t(threads) && tile.cols > 4 * kernel.nr)
+        tile.cols = round(tile.cols / 2, kernel.nr);
+    while (count() < 4 * std::size_t(threads) && tile.rows > 4 * kernel.mr)
+        tile.rows = round(tile.rows / 2, kernel.mr);
+    return tile;
+}
+
+template<class T>
+void Gemm<T>::MulParallel(i_type m, i_type n, i_type k,
+                          const T *A, i_type lda,
+                          const T *B, i_type ldb,
+                          T *C, i_type ldc,
+                          bool accumulate)
+{
+    const unsigned threads = parallel::Threads();
+    const Kernel kernel = GetKernel();
+    if (threads < 2 || (unsigned long)m * n * k <= 8 * small_cap)
+    {
+        Mul(m, n, k, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    parallel::ThreadPool &pool = parallel::ThreadPool::ForThreads(threads);
+    const Tiling tile = GetTiling(kernel, m, n, pool.Size());
+    const i_type row_tiles = (m + tile.rows - 1) / tile.rows;
+    const i_type tiles = row_tiles * ((n + tile.cols - 1) / tile.cols);
+    // Neighbouring tasks share a column panel of B; idle threads steal
+    // the tiles still queued
+    parallel::For(0, tiles, 1, [&](i_type from, i_type to)
+    {
+        for (i_type t = from; t < to; ++t)
+        {
+            const i_type i = t % row_tiles * tile.rows, j = t / row_tiles * tile.cols;
+            Mul(std::min(tile.rows, m - i), std::min(tile.cols, n - j), k,
+                A + i * lda, lda, B + j, ldb, C + i * ldc + j, ldc, accumulate);
+        }
+    }, pool);
+}
+
+} // namespace maykitbo
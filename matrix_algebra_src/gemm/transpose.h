@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../parallel/thread_pool.h"
+#include "../simd/kernels.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace maykitbo {
+
+// Out-of-place transpose D (cols x rows) = S (rows x cols)^T, row-major
+// with leading dimensions.
+//
+// Cache-oblivious: the longer side is halved until a block fits in L1
+// both as rows of S and as rows of D, whatever the cache sizes. A block
+// is swept in tile x tile squares turned in registers, see
+// simd::Kernels::transpose; the ragged edges of S are copied one element
+// at a time. When the leading dimensions keep the rows in step with the
+// cache lines, the rows and columns before the first line-aligned ones are
+// split off, so the wide tiles never load or store across a line.
+template<class T>
+class Transposition
+{
+    public:
+        using i_type = unsigned;
+
+        static void Run(i_type rows, i_type cols, const T *S, i_type lds, T *D, i_type ldd);
+        // Run with the halves of the blocks of grain elements and more as
+        // stealable tasks on the pool of the thread budget
+        static void RunParallel(i_type rows, i_type cols, const T *S, i_type lds, T *D, i_type ldd);
+
+        // Elements of the smallest block split in tasks, about 512 KB of
+        // double moved
+        static constexpr std::size_t grain = std::size_t(1) << 16;
+
+    private:
+        // Side of a block no longer halved
+        static constexpr i_type leaf = 32;
+
+        // Line the tiles are aligned to
+        static constexpr std::size_t line = 64;
+
+        static void Start(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                          const T *S, i_type lds, T *D, i_type ldd, parallel::ThreadPool *pool);
+        // Elements of T before the first line-aligned one from p
+        static i_type Skip(const T *p);
+        static void Recurse(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                            const T *S, i_type lds, T *D, i_type ldd,
+                            parallel::ThreadPool *pool);
+        static void Leaf(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                         const T *S, i_type lds, T *D, i_type ldd);
+};
+
+template<class T>
+void Transposition<T>::Run(i_type rows, i_type cols, const T *S, i_type lds, T *D, i_type ldd)
+{
+    Start(simd::Kernels<T>::Get(), rows, cols, S, lds, D, ldd, nullptr);
+}
+
+template<class T>
+void Transposition<T>::RunParallel(i_type rows, i_type cols, const T *S, i_type lds,
+                                   T *D, i_type ldd)
+{
+    const unsigned threads = parallel::Threads();
+    parallel::ThreadPool *pool = nullptr;
+    if (threads > 1 && std::size_t(rows) * cols >= 2 * grain)
+        pool = &parallel::ThreadPool::ForThreads(threads);
+    Start(simd::Kernels<T>::Get(), rows, cols, S, lds, D, ldd, pool);
+}
+
+template<class T>
+void Transposition<T>::Start(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                             const T *S, i_type lds, T *D, i_type ldd,
+                             parallel::ThreadPool *pool)
+{
+    i_type head_rows = 0, head_cols = 0;
+    if (line % sizeof(T) == 0 && std::size_t(lds) * sizeof(T) % line == 0 &&
+        std::size_t(ldd) * sizeof(T) % line == 0)
+    {
+        head_rows = std::min(rows, Skip(D));
+        head_cols = std::min(cols, Skip(S));
+    }
+    if (head_rows > 0)
+        Recurse(K, head_rows, cols, S, lds, D, ldd, nullptr);
+    if (head_cols > 0 && rows > head_rows)
+        Recurse(K, rows - head_rows, head_cols, S + std::size_t(head_rows) * lds, lds,
+                D + head_rows, ldd, nullptr);
+    if (rows > head_rows && cols > head_cols)
+        Recurse(K, rows - head_rows, cols - head_cols,
+                S + std::size_t(head_rows) * lds + head_cols, lds,
+                D + std::size_t(head_cols) * ldd + head_rows, ldd, pool);
+}
+
+template<class T>
+typename Transposition<T>::i_type Transposition<T>::Skip(const T *p)
+{
+    const std::size_t address = reinterpret_cast<std::uintptr_t>(p);
+    if (address % sizeof(T) != 0)
+        return 0;
+    return i_type((line - address % line) % line / sizeof(T));
+}
+
+template<class T>
+void Transposition<T>::Recurse(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                               const T *S, i_type lds, T *D, i_type ldd,
+                               parallel::ThreadPool *pool)
+{
+    if (rows <= leaf && cols <= leaf)
+    {
+        Leaf(K, rows, cols, S, lds, D, ldd);
+        return;
+    }
+
+    // Halves on tile boundaries keep every block but the last of a side
+    // free of ragged edges
+    const bool by_rows = rows >= cols;
+    const i_type half = (by_rows ? rows : cols) / 2 / K.tile * K.tile;
+    const i_type rows1 = by_rows ? half : rows, cols1 = by_rows ? cols : half;
+    const T *S2 = by_rows ? S + std::size_t(half) * lds : S + half;
+    T *D2 = by_rows ? D + half : D + std::size_t(half) * ldd;
+    const i_type rows2 = rows - (by_rows ? half : 0), cols2 = cols - (by_rows ? 0 : half);
+
+    if (pool == nullptr || std::size_t(rows) * cols < 2 * grain)
+    {
+        Recurse(K, rows1, cols1, S, lds, D, ldd, nullptr);
+        Recurse(K, rows2, cols2, S2, lds, D2, ldd, nullptr);
+        return;
+    }
+    parallel::TaskGroup tasks(*pool);
+    tasks.Run([=, &K] { Recurse(K, rows2, cols2, S2, lds, D2, ldd, pool); });
+    Recurse(K, rows1, cols1, S, lds, D, ldd, pool);
+    tasks.Wait();
+}
+
+template<class T>
+void Transposition<T>::Leaf(const simd::Kernels<T> &K, i_type rows, i_type cols,
+                            const T *S, i_type lds, T *D, i_type ldd)
+{
+    const i_type tile = K.tile;
+    const i_type full_rows = rows / tile * tile, full_cols = cols / tile * tile;
+    for (i_type i = 0; i < full_rows; i += tile)
+    {
+        for (i_type j = 0; j < full_cols; j += tile)
+            K.transpose(S + std::size_t(i) * lds + j, lds, D + std::size_t(j) * ldd + i, ldd);
+        for (i_type r = i; r < i + tile; ++r)
+            for (i_type j = full_cols; j < cols; ++j)
+                D[std::size_t(j) * ldd + r] = S[std::size_t(r) * lds + j];
+    }
+    for (i_type i = full_rows; i < rows; ++i)
+        for (i_type j = 0; j < cols; ++j)
+            D[std::size_t(j) * ldd + i] = S[std::size_t(i) * lds + j];
+}
+
+} // namespace maykitbo
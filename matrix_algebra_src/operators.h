@@ -37,7 +37,7 @@ Matrix<T> Matrix<T>::operator+(T value) const
 template <class T>
 Matrix<T> &Matrix<T>::operator-=(const Matrix &other)
 {
-    Algebra::Sum(*this, other * -1, *this);
+    Algebra::Sub(*this, other, *this);
     return *this;
 }
 
@@ -45,7 +45,7 @@ template <class T>
 Matrix<T> Matrix<T>::operator-(const Matrix &other) const
 {
     Matrix result(rows_, cols_);
-    Algebra::Sum(*this, other * -1, result);
+    Algebra::Sub(*this, other, result);
     return result;
 }
 
@@ -67,7 +67,7 @@ Matrix<T> Matrix<T>::operator-(T value) const
 template <class T>
 Matrix<T> &Matrix<T>::operator*=(const Matrix &other)
 {
-    Algebra::Mul(*this, other, *this);
+    *this = *this * other;
     return *this;
 }
 
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "cancel.h"
+#include "thread_pool.h"
+#include "topology.h"
+
+#include <exception>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace maykitbo {
+
+namespace parallel {
+
+namespace detail {
+
+// Posts job to the idle workers of the shared pool under the thread
+// budget and cancel scopes of the caller, or runs it at once when the
+// pool has no worker to take it
+template<class F>
+void Launch(F &&job)
+{
+    auto run = [job = std::forward<F>(job), threads = ScopedThreads(),
+                cancel = CancelToken::Current()]() mutable
+    {
+        ThreadBudget budget(threads);
+        CancelScope scope(cancel);
+        job();
+    };
+    ThreadPool &pool = ThreadPool::Shared();
+    if (pool.Size() < 2)
+        run();
+    else
+        pool.Post(std::move(run));
+}
+
+} // namespace detail
+
+// Runs task on the shared pool and returns its future, which also
+// carries what task throws. Idle workers start the tasks in flight one
+// each, in order, and share the rest of the pool with the products they
+// run, so independent products pipeline; a thread waiting on its own
+// product never picks one up. Whatever task
+// references must outlive it. On a pool without workers task runs before
+// Async returns.
+template<class F>
+std::future<std::invoke_result_t<std::decay_t<F>>> Async(F &&task)
+{
+    using R = std::invoke_result_t<std::decay_t<F>>;
+    auto job = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+    std::future<R> future = job->get_future();
+    detail::Launch([job] { (*job)(); });
+    return future;
+}
+
+// Async with a completion callback instead of a future: done(error) runs
+// on the worker that ran task, with a null error on success. done has no
+// one to throw to: what it throws is dropped.
+template<class F, class Done>
+void Async(F &&task, Done &&done)
+{
+    detail::Launch([task = std::forward<F>(task), done = std::forward<Done>(done)]() mutable
+    {
+        std::exception_ptr error;
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        try
+        {
+            done(error);
+        }
+        catch (...)
+        {
+        }
+    });
+}
+
+} // namespace parallel
+
+} // namespace maykitbo
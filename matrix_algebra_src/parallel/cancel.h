@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace maykitbo {
+
+namespace parallel {
+
+namespace detail {
+
+struct StopState
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<bool> cancelled{false};
+    Clock::time_point deadline = Clock::time_point::max();
+};
+
+} // namespace detail
+
+// Stop of one or more products, set by Cancel from any thread or by the
+// deadline passing. Copies share the state. The products of a thread see
+// the token of its innermost CancelScope.
+class CancelToken
+{
+    public:
+        using Clock = detail::StopState::Clock;
+
+        CancelToken() : state_(std::make_shared<detail::StopState>()) {}
+        // Stopped once deadline passes, or on Cancel before
+        static CancelToken Until(Clock::time_point deadline)
+        {
+            CancelToken token;
+            token.state_->deadline = deadline;
+            return token;
+        }
+        static CancelToken After(Clock::duration timeout) { return Until(Clock::now() + timeout); }
+        // Token in scope on the calling thread, one that never stops if none
+        static CancelToken Current() noexcept;
+
+        void Cancel() noexcept
+        {
+            if (state_)
+                state_->cancelled.store(true, std::memory_order_relaxed);
+        }
+        bool Cancelled() const noexcept
+        {
+            return state_ && state_->cancelled.load(std::memory_order_relaxed);
+        }
+        bool Expired() const noexcept
+        {
+            return state_ && state_->deadline != Clock::time_point::max() &&
+                   Clock::now() >= state_->deadline;
+        }
+        bool Stopped() const noexcept { return Cancelled() || Expired(); }
+
+    private:
+        friend class CancelScope;
+
+        explicit CancelToken(std::shared_ptr<detail::StopState> state) noexcept
+            : state_(std::move(state))
+        {}
+
+        std::shared_ptr<detail::StopState> state_;
+};
+
+// What a stopped product throws, out of the engine or through its future;
+// the output matrix is left partly written
+class Cancelled : public std::runtime_error
+{
+    public:
+        explicit Cancelled(bool expired)
+            : std::runtime_error(expired ? "maykitbo: deadline exceeded" : "maykitbo: cancelled"),
+              expired_(expired)
+        {}
+        // The deadline passed rather than Cancel was called
+        bool Expired() const noexcept { return expired_; }
+
+    private:
+        bool expired_;
+};
+
+namespace detail {
+
+inline std::shared_ptr<StopState> &ScopedStop() noexcept
+{
+    thread_local std::shared_ptr<StopState> state;
+    return state;
+}
+
+} // namespace detail
+
+inline CancelToken CancelToken::Current() noexcept
+{
+    return CancelToken(detail::ScopedStop());
+}
+
+// Token of the products the calling thread runs while it lives; the
+// tasks of their TaskGroups and Async carry it to the workers
+class CancelScope
+{
+    public:
+        explicit CancelScope(const CancelToken &token) noexcept
+            : previous_(std::exchange(detail::ScopedStop(), token.state_))
+        {}
+        ~CancelScope() { detail::ScopedStop() = std::move(previous_); }
+        CancelScope(const CancelScope &) = delete;
+        CancelScope &operator=(const CancelScope &) = delete;
+
+    private:
+        std::shared_ptr<detail::StopState> previous_;
+};
+
+// Throws Cancelled once the token in scope stopped. The engines call it
+// between levels, tiles and tasks: a stopped product unwinds within a leaf
+// or a Gemm panel, its workspace freed, its queued tasks dropped.
+inline void CheckCancel()
+{
+    const detail::StopState *state = detail::ScopedStop().get();
+    if (state == nullptr)
+        return;
+    if (state->cancelled.load(std::memory_order_relaxed))
+        throw Cancelled(false);
+    if (state->deadline != detail::StopState::Clock::time_point::max() &&
+        detail::StopState::Clock::now() >= state->deadline)
+        throw Cancelled(true);
+}
+
+} // namespace parallel
+
+} // namespace maykitbo
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../simd/cpu.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace maykitbo {
+
+namespace parallel {
+
+// Elements of one element-wise task: about 256 KB of double, long enough
+// to hide the cost of a task. Ops of less than two stay on the caller.
+constexpr unsigned elementwise_grain = 1u << 15;
+
+// Runs kernel(from, to, stream) over [0, size) of a memory-bound
+// element-wise op that writes bytes of result apart from its operands, 0
+// in place: split across the pool of the thread budget from 2 grains up,
+// four tasks a thread at most, with stream set once the result no longer
+// fits the last-level cache.
+template<class F>
+void Elementwise(unsigned size, std::size_t bytes, const F &kernel)
+{
+    static const std::size_t llc = simd::CacheSize(3);
+    const bool stream = bytes > llc;
+    const unsigned threads = Threads();
+    if (threads < 2 || size < 2 * elementwise_grain)
+    {
+        kernel(0u, size, stream);
+        return;
+    }
+    ThreadPool &pool = ThreadPool::ForThreads(threads);
+    const unsigned grain = std::max(elementwise_grain, size / (4 * pool.Size()));
+    For(0, size, grain, [&](unsigned from, unsigned to) { kernel(from, to, stream); }, pool);
+}
+
+} // namespace parallel
+
+} // namespace maykitbo
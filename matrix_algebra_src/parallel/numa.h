@@ -0,0 +1,172 @@
+#pragma once
+
+#include "topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef MAYKITBO_LIBNUMA
+    #include <numa.h>
+    #include <numaif.h>
+#endif
+
+namespace maykitbo {
+
+namespace parallel {
+
+namespace detail {
+
+// "0-3,8,10-11" of sysfs cpulist files
+inline std::vector<unsigned> ParseCpuList(const std::string &list)
+{
+    std::vector<unsigned> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        const std::size_t dash = range.find('-');
+        const unsigned from = std::stoul(range.substr(0, dash));
+        const unsigned to = dash == std::string::npos ? from : std::stoul(range.substr(dash + 1));
+        for (unsigned cpu = from; cpu <= to; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+inline std::atomic<bool> &Numa() noexcept
+{
+    static std::atomic<bool> numa{[] {
+        const char *numa = std::getenv("MAYKITBO_NUMA");
+        return numa != nullptr && numa[0] == '1';
+    }()};
+    return numa;
+}
+
+// False from the first time the kernel refuses to place memory
+inline std::atomic<bool> &Placeable() noexcept
+{
+    static std::atomic<bool> placeable{true};
+    return placeable;
+}
+
+} // namespace detail
+
+// NUMA nodes of the CPUs of the affinity mask, node ids as in sysfs;
+// one node 0 with every CPU where the machine or the OS tells none
+inline std::vector<std::pair<unsigned, std::vector<unsigned>>> Nodes()
+{
+    const std::vector<unsigned> allowed = Cpus();
+    std::vector<std::pair<unsigned, std::vector<unsigned>>> nodes;
+    // Node ids can have gaps, nodes are few: probe a fixed range
+    for (unsigned node = 0; node < 64; ++node)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!(file >> list))
+            continue;
+        std::vector<unsigned> cpus;
+        for (unsigned cpu : detail::ParseCpuList(list))
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            nodes.emplace_back(node, std::move(cpus));
+    }
+    if (nodes.empty())
+        nodes.emplace_back(0, allowed);
+    return nodes;
+}
+
+// Node of cpu, 0 when unknown
+inline unsigned NodeOf(unsigned cpu)
+{
+    static const auto nodes = Nodes();
+    for (const auto &[node, cpus] : nodes)
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+            return node;
+    return 0;
+}
+
+namespace detail {
+
+// Two nodes or more to place memory on: libnuma's view in builds with
+// MAYKITBO_LIBNUMA defined (link -lnuma), the nodes of sysfs otherwise
+inline bool MultiNode() noexcept
+{
+    static const bool multi = [] {
+#ifdef MAYKITBO_LIBNUMA
+        return numa_available() >= 0 && numa_num_configured_nodes() > 1;
+#else
+        return Nodes().size() > 1;
+#endif
+    }();
+    return multi;
+}
+
+} // namespace detail
+
+// NUMA mode of the parallel engines: the tasks of the top parallel level
+// run on home workers spread over the nodes, their buffers placed on the
+// node of their home. Off unless MAYKITBO_NUMA=1 or SetNuma, on machines
+// with a single node and for good once PlaceMemory fails; it applies to
+// plans made after it is set.
+inline bool Numa() noexcept
+{
+    return detail::Numa().load(std::memory_order_relaxed) &&
+           detail::Placeable().load(std::memory_order_relaxed) && detail::MultiNode();
+}
+
+inline void SetNuma(bool numa) noexcept
+{
+    detail::Numa().store(numa, std::memory_order_relaxed);
+}
+
+// Moves the whole pages of [data, data + bytes) to node and keeps them
+// there (mbind, preferred policy), with libnuma's mbind in builds with
+// MAYKITBO_LIBNUMA defined; false where unsupported or refused, and a
+// refusal turns Numa mode off
+inline bool PlaceMemory(void *data, std::size_t bytes, unsigned node)
+{
+#if defined(__linux__) && (defined(MAYKITBO_LIBNUMA) || defined(SYS_mbind))
+    const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    const std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(data) + page - 1) / page * page;
+    const std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + bytes) / page * page;
+    if (node >= 64 || begin >= end)
+        return false;
+    unsigned long mask = 1ul << node;
+#ifdef MAYKITBO_LIBNUMA
+    const bool placed = mbind(reinterpret_cast<void *>(begin), end - begin, MPOL_PREFERRED, &mask,
+                              65, MPOL_MF_MOVE) == 0;
+#else
+    constexpr int preferred = 1;     // MPOL_PREFERRED
+    constexpr unsigned move = 1u << 1;  // MPOL_MF_MOVE
+    const bool placed = syscall(SYS_mbind, begin, end - begin, preferred, &mask, 65, move) == 0;
+#endif
+    if (!placed)
+        detail::Placeable().store(false, std::memory_order_relaxed);
+    return placed;
+#else
+    (void)data;
+    (void)bytes;
+    (void)node;
+    detail::Placeable().store(false, std::memory_order_relaxed);
+    return false;
+#endif
+}
+
+} // namespace parallel
+
+} // namespace maykitbo
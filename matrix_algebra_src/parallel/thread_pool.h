@@ -0,0 +1,447 @@
+#pragma once
+
+#include "cancel.h"
+#include "numa.h"
+#include "topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace maykitbo {
+
+namespace parallel {
+
+// Persistent work-stealing workers the parallel engines submit their
+// tasks to. A worker pushes and pops the tasks it submits at the back of
+// its own deque, idle workers steal the oldest from the front of the
+// others', and threads outside the pool submit to a shared queue. Threads
+// waiting on a TaskGroup run tasks themselves, so a pool of any size,
+// even none, makes progress and nested groups cannot deadlock.
+class ThreadPool
+{
+    public:
+        using Task = std::function<void()>;
+
+        // pin binds worker i to the i+1-th CPU of Cpus(), round robin,
+        // leaving the first to the caller
+        explicit ThreadPool(unsigned workers, bool pin = false);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // Started on first use with a worker per AvailableThreads but the
+        // caller's, pinned when MAYKITBO_PIN is set to 1 or in Numa mode
+        static ThreadPool &Shared();
+        // Pool a budget of threads runs on: Shared when it has no more
+        // threads, else one kept for that budget, pinned in Numa mode.
+        // 0 stands for Threads().
+        static ThreadPool &ForThreads(unsigned threads = 0);
+
+        // Threads that run tasks: the workers and the waiting caller
+        unsigned Size() const noexcept { return static_cast<unsigned>(workers_.size()) + 1; }
+        // Levels of fanout-way task splits that leave every thread at
+        // least two tasks to take, at least 1
+        unsigned Depth(unsigned fanout) const noexcept;
+
+        // Node of a pinned worker, -1 for an unpinned one
+        int Node(unsigned worker) const noexcept { return worker_nodes_[worker]; }
+        // Worker the task-th of a set of tasks should start on, spread
+        // round robin over the nodes of the workers; -1 unless the pool
+        // is pinned over two nodes or more
+        int Home(unsigned task) const;
+
+        void Submit(Task task);
+        // Queues task on worker's own deque, where idle workers may still
+        // steal it
+        void Submit(Task task, unsigned worker);
+        // Queues task for idle workers only: threads waiting on a TaskGroup
+        // never run it, so a long job cannot hold up their own tasks
+        void Post(Task task);
+        // Runs one task on the calling thread, false if none is queued
+        bool RunOne();
+        // Index of the calling worker of this pool, Size() - 1 for any
+        // other thread
+        unsigned Self() const noexcept;
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void Work(unsigned index, int cpu);
+        // Own deque from the back, then the shared queue, then steals,
+        // then the posted tasks for an idle worker
+        bool Take(Task &task, bool idle = false);
+        // Counts a newly queued task and wakes a sleeping worker, or all
+        void Wake(bool all);
+
+        // One deque per worker, the last is the shared queue
+        std::vector<std::unique_ptr<Queue>> queues_;
+        Queue posted_;
+        std::vector<std::thread> workers_;
+        std::vector<int> worker_nodes_;
+        std::atomic<std::size_t> queued_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable ready_;
+        bool stop_ = false;
+};
+
+// Tasks submitted together and waited for together. The first exception
+// a task throws is rethrown by Wait.
+class TaskGroup
+{
+    public:
+        explicit TaskGroup(ThreadPool &pool = ThreadPool::Shared()) : pool_(pool) {}
+        ~TaskGroup();
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        template<class F>
+        void Run(F &&task);
+        // Run starting on worker, see ThreadPool::Home; a negative worker
+        // is any
+        template<class F>
+        void RunOn(int worker, F &&task);
+        void Wait();
+
+    private:
+        void Done(std::exception_ptr error);
+
+        ThreadPool &pool_;
+        std::mutex mutex_;
+        std::condition_variable done_;
+        unsigned pending_ = 0;
+        std::exception_ptr error_;
+};
+
+// body(from, to) over [begin, end) cut in halves down to grain, every
+// half a stealable task
+template<class F>
+void For(unsigned begin, unsigned end, unsigned grain, const F &body,
+         ThreadPool &pool = ThreadPool::Shared());
+
+namespace detail {
+
+struct Worker
+{
+    const ThreadPool *pool = nullptr;
+    unsigned index = 0;
+};
+
+inline Worker &CurrentWorker() noexcept
+{
+    thread_local Worker worker;
+    return worker;
+}
+
+template<class F>
+void Split(TaskGroup &group, unsigned from, unsigned to, unsigned grain, const F &body)
+{
+    while (to - from > grain)
+    {
+        const unsigned mid = from + (to - from) / 2;
+        group.Run([&group, mid, to, grain, &body] { Split(group, mid, to, grain, body); });
+        to = mid;
+    }
+    body(from, to);
+}
+
+} // namespace detail
+
+inline ThreadPool::ThreadPool(unsigned workers, bool pin)
+{
+    for (unsigned i = 0; i <= workers; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    const std::vector<unsigned> cpus = pin ? Cpus() : std::vector<unsigned>();
+    workers_.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        const int cpu = pin ? static_cast<int>(cpus[(i + 1) % cpus.size()]) : -1;
+        worker_nodes_.push_back(pin ? static_cast<int>(NodeOf(cpu)) : -1);
+        workers_.emplace_back(&ThreadPool::Work, this, i, cpu);
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread &worker : workers_)
+        worker.join();
+}
+
+inline ThreadPool &ThreadPool::Shared()
+{
+    static ThreadPool pool(AvailableThreads() - 1, [] {
+        const char *pin = std::getenv("MAYKITBO_PIN");
+        return Numa() || (pin != nullptr && pin[0] == '1');
+    }());
+    return pool;
+}
+
+inline ThreadPool &ThreadPool::ForThreads(unsigned threads)
+{
+    if (threads == 0)
+        threads = Threads();
+    ThreadPool &shared = Shared();
+    if (threads >= shared.Size())
+        return shared;
+    // Idle workers sleep: a pool per budget in use costs no CPU time;
+    // pinned ones in Numa mode, for the homes of the parallel engines
+    static std::mutex mutex;
+    static std::map<std::pair<unsigned, bool>, std::unique_ptr<ThreadPool>> pools;
+    const bool pin = Numa();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<ThreadPool> &pool = pools[{threads, pin}];
+    if (!pool)
+        pool = std::make_unique<ThreadPool>(threads - 1, pin);
+    return *pool;
+}
+
+inline unsigned ThreadPool::Depth(unsigned fanout) const noexcept
+{
+    unsigned depth = 1;
+    for (std::size_t tasks = fanout; tasks < 2 * std::size_t(Size()) && fanout > 1; tasks *= fanout)
+        ++depth;
+    return depth;
+}
+
+inline unsigned ThreadPool::Self() const noexcept
+{
+    const detail::Worker &worker = detail::CurrentWorker();
+    return worker.pool == this ? worker.index : static_cast<unsigned>(workers_.size());
+}
+
+inline int ThreadPool::Home(unsigned task) const
+{
+    std::vector<int> nodes;
+    for (int node : worker_nodes_)
+        if (node >= 0 && std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+            nodes.push_back(node);
+    if (nodes.size() < 2)
+        return -1;
+    const int node = nodes[task % nodes.size()];
+    unsigned skip = task / static_cast<unsigned>(nodes.size());
+    std::vector<unsigned> on_node;
+    for (unsigned worker = 0; worker < worker_nodes_.size(); ++worker)
+        if (worker_nodes_[worker] == node)
+            on_node.push_back(worker);
+    return static_cast<int>(on_node[skip % on_node.size()]);
+}
+
+inline void ThreadPool::Submit(Task task)
+{
+    Submit(std::move(task), Self());
+}
+
+inline void ThreadPool::Submit(Task task, unsigned worker)
+{
+    worker = std::min(worker, static_cast<unsigned>(workers_.size()));
+    Queue &queue = *queues_[worker];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    // Another's deque: wake its owner, not just any worker that would
+    // steal the task
+    Wake(worker != Self());
+}
+
+inline void ThreadPool::Post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(posted_.mutex);
+        posted_.tasks.push_back(std::move(task));
+    }
+    Wake(false);
+}
+
+inline void ThreadPool::Wake(bool all)
+{
+    queued_.fetch_add(1, std::memory_order_release);
+    {
+        // Pairs with the check of queued_ in Work: no wakeup gets lost
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    if (all)
+        ready_.notify_all();
+    else
+        ready_.notify_one();
+}
+
+inline bool ThreadPool::Take(Task &task, bool idle)
+{
+    if (queued_.load(std::memory_order_acquire) == 0)
+        return false;
+    const unsigned self = Self(), shared = static_cast<unsigned>(workers_.size());
+    auto pop_from = [&](Queue &queue, bool back)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        if (back)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    };
+    auto pop = [&](unsigned index, bool back) { return pop_from(*queues_[index], back); };
+    if (self != shared && pop(self, true))
+        return true;
+    if (pop(shared, false))
+        return true;
+    for (unsigned i = 1; i <= shared; ++i)
+    {
+        const unsigned victim = (self + i) % (shared + 1);
+        if (victim != shared && pop(victim, false))
+            return true;
+    }
+    return idle && pop_from(posted_, false);
+}
+
+inline bool ThreadPool::RunOne()
+{
+    Task task;
+    if (!Take(task))
+        return false;
+    task();
+    return true;
+}
+
+inline void ThreadPool::Work(unsigned index, int cpu)
+{
+    if (cpu >= 0)
+        PinThread(static_cast<unsigned>(cpu));
+    detail::CurrentWorker() = {this, index};
+    for (;;)
+    {
+        Task task;
+        if (Take(task, true))
+        {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        ready_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+        if (stop_ && queued_.load(std::memory_order_acquire) == 0)
+            return;
+    }
+}
+
+inline TaskGroup::~TaskGroup()
+{
+    // Tasks reference the group: never leave before they are done
+    try
+    {
+        Wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+template<class F>
+void TaskGroup::Run(F &&task)
+{
+    RunOn(-1, std::forward<F>(task));
+}
+
+template<class F>
+void TaskGroup::RunOn(int worker, F &&task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    // A task of a stopped product is dropped unrun
+    auto wrapped = [this, task = std::forward<F>(task), cancel = CancelToken::Current()]() mutable
+    {
+        std::exception_ptr error;
+        try
+        {
+            CancelScope scope(cancel);
+            CheckCancel();
+            task();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        Done(error);
+    };
+    if (worker < 0)
+        pool_.Submit(std::move(wrapped));
+    else
+        pool_.Submit(std::move(wrapped), static_cast<unsigned>(worker));
+}
+
+inline void TaskGroup::Done(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error && !error_)
+        error_ = error;
+    if (--pending_ == 0)
+        done_.notify_all();
+}
+
+inline void TaskGroup::Wait()
+{
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_ == 0)
+                break;
+        }
+        if (pool_.RunOne())
+            continue;
+        // Whatever is left runs elsewhere; look again for new work
+        // those tasks queue in the meantime
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait_for(lock, std::chrono::microseconds(50), [this] { return pending_ == 0; });
+    }
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(error, error_);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template<class F>
+void For(unsigned begin, unsigned end, unsigned grain, const F &body, ThreadPool &pool)
+{
+    if (begin >= end)
+        return;
+    TaskGroup group(pool);
+    detail::Split(group, begin, end, std::max(grain, 1u), body);
+    group.Wait();
+}
+
+} // namespace parallel
+
+} // namespace maykitbo
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace maykitbo {
+
+namespace parallel {
+
+// CPUs the process may run on: its affinity mask on Linux, else every
+// hardware thread
+inline std::vector<unsigned> Cpus()
+{
+    std::vector<unsigned> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+    }
+#endif
+    if (cpus.empty())
+    {
+        for (unsigned cpu = 0, count = std::max(1u, std::thread::hardware_concurrency()); cpu < count; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+namespace detail {
+
+// Cgroup of the process in /proc/self/cgroup text: the "0::" entry of v2,
+// or the v1 hierarchy with the cpu controller; "" when there is none
+inline std::string ParseCgroup(const std::string &text, bool v2)
+{
+    std::stringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        const std::size_t first = line.find(':'), second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos)
+            continue;
+        const std::string path = line.substr(second + 1);
+        if (path.empty() || path[0] != '/')
+            continue;
+        if (v2)
+        {
+            if (line.compare(0, second + 1, "0::") == 0)
+                return path;
+            continue;
+        }
+        std::stringstream controllers(line.substr(first + 1, second - first - 1));
+        std::string controller;
+        while (std::getline(controllers, controller, ','))
+            if (controller == "cpu")
+                return path;
+    }
+    return "";
+}
+
+// Quota of the cgroup directory dir in CPUs, 0 when unlimited or unknown
+inline double CgroupQuota(const std::string &dir, bool v2)
+{
+    double period = 0;
+    if (v2)
+    {
+        std::ifstream max(dir + "/cpu.max");
+        std::string quota;
+        if (max >> quota >> period && quota != "max" && period > 0)
+            return std::stod(quota) / period;
+        return 0;
+    }
+    std::ifstream quota(dir + "/cpu.cfs_quota_us"), periods(dir + "/cpu.cfs_period_us");
+    double us = 0;
+    if (quota >> us && periods >> period && us > 0 && period > 0)
+        return us / period;
+    return 0;
+}
+
+// Tightest quota of the cgroup path under the hierarchy mounted at root
+// and of its ancestors; missing directories count as unlimited
+inline double TightestQuota(const std::string &root, std::string path, bool v2)
+{
+    double tightest = 0;
+    for (;; path.erase(path.rfind('/')))
+    {
+        const double quota = CgroupQuota(root + path, v2);
+        if (quota > 0 && (tightest == 0 || quota < tightest))
+            tightest = quota;
+        if (path.empty())
+            return tightest;
+    }
+}
+
+} // namespace detail
+
+// CPU time the cgroup of the process may use, in CPUs, 0 when unlimited
+// or unknown: the tightest cpu.max of cgroup v2, else cpu.cfs_quota_us /
+// period of v1, over the cgroup of /proc/self/cgroup and its ancestors.
+// Where a bind mount or a cgroup namespace roots the hierarchy lower,
+// the paths that do not exist under it are skipped.
+inline double CpuQuota()
+{
+    std::ifstream proc("/proc/self/cgroup");
+    std::stringstream text;
+    text << proc.rdbuf();
+    for (bool v2 : {true, false})
+    {
+        const double quota = detail::TightestQuota(v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu",
+                                                   detail::ParseCgroup(text.str(), v2), v2);
+        if (quota > 0)
+            return quota;
+    }
+    return 0;
+}
+
+// Threads the process can keep busy: the CPUs of its affinity mask, no
+// more than its cgroup quota rounded up, at least 1. Read once.
+inline unsigned AvailableThreads()
+{
+    static const unsigned threads = []
+    {
+        unsigned count = static_cast<unsigned>(Cpus().size());
+        const double quota = CpuQuota();
+        if (quota > 0)
+            count = std::min(count, static_cast<unsigned>(std::ceil(quota)));
+        return std::max(count, 1u);
+    }();
+    return threads;
+}
+
+// Binds the calling thread to cpu, false where unsupported or refused
+inline bool PinThread(unsigned cpu)
+{
+#ifdef __linux__
+    if (cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+namespace detail {
+
+// 0 stands for AvailableThreads
+inline std::atomic<unsigned> &DefaultThreads() noexcept
+{
+    static std::atomic<unsigned> threads{0};
+    return threads;
+}
+
+inline unsigned &ScopedThreads() noexcept
+{
+    thread_local unsigned threads = 0;
+    return threads;
+}
+
+} // namespace detail
+
+// Thread budget of the parallel engines on the calling thread: the
+// innermost ThreadBudget, else SetThreads, else AvailableThreads
+inline unsigned Threads() noexcept
+{
+    unsigned threads = detail::ScopedThreads();
+    if (threads == 0)
+        threads = detail::DefaultThreads().load(std::memory_order_relaxed);
+    return threads ? threads : AvailableThreads();
+}
+
+// Process-wide budget, 0 restores AvailableThreads
+inline void SetThreads(unsigned threads) noexcept
+{
+    detail::DefaultThreads().store(threads, std::memory_order_relaxed);
+}
+
+// Budget of the products the calling thread runs while it lives
+class ThreadBudget
+{
+    public:
+        explicit ThreadBudget(unsigned threads) noexcept : previous_(detail::ScopedThreads())
+        {
+            detail::ScopedThreads() = threads;
+        }
+        ~ThreadBudget() { detail::ScopedThreads() = previous_; }
+        ThreadBudget(const ThreadBudget &) = delete;
+        ThreadBudget &operator=(const ThreadBudget &) = delete;
+
+    private:
+        unsigned previous_;
+};
+
+} // namespace parallel
+
+} // namespace maykitbo
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define MAYKITBO_SIMD_X86
+#endif
+
+namespace maykitbo {
+
+namespace simd {
+
+// Instruction sets with hand-written kernels, ordered from weakest to strongest.
+enum class Isa { Generic, SSE2, AVX2, AVX512 };
+
+inline const char *IsaName(Isa isa) noexcept
+{
+    switch (isa)
+    {
+        case Isa::SSE2: return "sse2";
+        case Isa::AVX2: return "avx2";
+        case Isa::AVX512: return "avx512";
+        default: return "generic";
+    }
+}
+
+// Best instruction set supported by this CPU and OS.
+inline Isa DetectIsa() noexcept
+{
+#ifdef MAYKITBO_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return Isa::SSE2;
+#endif
+    return Isa::Generic;
+}
+
+namespace detail {
+
+// The MAYKITBO_SIMD environment variable can lower the detected level,
+// e.g. MAYKITBO_SIMD=sse2 to rule out frequency throttling from AVX-512.
+inline Isa StartupIsa() noexcept
+{
+    Isa best = DetectIsa();
+    const char *env = std::getenv("MAYKITBO_SIMD");
+    if (env == nullptr)
+        return best;
+    for (Isa isa : {Isa::Generic, Isa::SSE2, Isa::AVX2, Isa::AVX512})
+    {
+        if (std::strcmp(env, IsaName(isa)) == 0 && isa <= best)
+            return isa;
+    }
+    return best;
+}
+
+inline std::atomic<Isa> &Active() noexcept
+{
+    static std::atomic<Isa> active{StartupIsa()};
+    return active;
+}
+
+} // namespace detail
+
+// Instruction set the kernels are currently dispatched to.
+inline Isa ActiveIsa() noexcept
+{
+    return detail::Active().load(std::memory_order_relaxed);
+}
+
+// Switches dispatch to isa, or to the best supported level below it.
+// Returns the level actually selected.
+inline Isa SetIsa(Isa isa) noexcept
+{
+    Isa best = DetectIsa();
+    if (isa > best)
+        isa = best;
+    detail::Active().store(isa, std::memory_order_relaxed);
+    return isa;
+}
+
+// Bytes of the data cache at level 1, 2 or 3, typical sizes where the
+// OS does not tell
+inline std::size_t CacheSize(int level) noexcept
+{
+    long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    if (level == 1) size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (level == 2) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (level == 3) size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if (size > 0)
+        return size;
+    if (level == 1) return 32 * 1024;
+    if (level == 2) return 256 * 1024;
+    return 8 * 1024 * 1024;
+}
+
+} // namespace simd
+
+} // namespace maykitbo
@@ -0,0 +1,82 @@
+#pragma once
+
+namespace maykitbo {
+
+namespace simd {
+
+// Portable kernels, used for every element type without hand-written
+// vector code and on hosts without a supported instruction set.
+namespace generic {
+
+template<class T>
+void Add(unsigned size, const T *a, const T *b, T *c)
+{
+    for (unsigned k = 0; k < size; ++k)
+        c[k] = a[k] + b[k];
+}
+
+template<class T>
+void Sub(unsigned size, const T *a, const T *b, T *c)
+{
+    for (unsigned k = 0; k < size; ++k)
+        c[k] = a[k] - b[k];
+}
+
+template<class T>
+void AddScalar(unsigned size, const T *a, T value, T *c)
+{
+    for (unsigned k = 0; k < size; ++k)
+        c[k] = a[k] + value;
+}
+
+template<class T>
+void Scale(unsigned size, const T *a, T value, T *c)
+{
+    for (unsigned k = 0; k < size; ++k)
+        c[k] = a[k] * value;
+}
+
+// MR x NR register tile of C (+)= packed A micro-panel * packed B micro-panel
+template<class T, unsigned MR, unsigned NR>
+void Gemm(unsigned kc, const T *a, const T *b, T *c, unsigned ldc, bool accumulate)
+{
+    T acc[MR][NR] = {};
+    for (unsigned p = 0; p < kc; ++p, a += MR, b += NR)
+    {
+        for (unsigned i = 0; i < MR; ++i)
+        {
+            const T ai = a[i];
+            for (unsigned j = 0; j < NR; ++j)
+            {
+                acc[i][j] += ai * b[j];
+            }
+        }
+    }
+    for (unsigned i = 0; i < MR; ++i)
+    {
+        T *ci = c + i * ldc;
+        for (unsigned j = 0; j < NR; ++j)
+        {
+            ci[j] = accumulate ? ci[j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+// tile x tile block d = s^T
+template<class T, unsigned tile>
+void Transpose(const T *s, unsigned lds, T *d, unsigned ldd)
+{
+    for (unsigned i = 0; i < tile; ++i)
+    {
+        for (unsigned j = 0; j < tile; ++j)
+        {
+            d[j * ldd + i] = s[i * lds + j];
+        }
+    }
+}
+
+} // namespace generic
+
+} // namespace simd
+
+} // namespace maykitbo
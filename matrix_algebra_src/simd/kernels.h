@@ -0,0 +1,105 @@
+#pragma once
+
+#include "cpu.h"
+#include "generic.h"
+#include "x86.h"
+
+#include <type_traits>
+
+namespace maykitbo {
+
+namespace simd {
+
+// Dispatch table of the vectorized primitives for element type T.
+// float and double get hand-written kernels for every instruction set,
+// other types always use the portable ones.
+template<class T>
+struct Kernels
+{
+    using binary_t = void (*)(unsigned, const T *, const T *, T *);
+    using scalar_t = void (*)(unsigned, const T *, T, T *);
+    using gemm_t = void (*)(unsigned, const T *, const T *, T *, unsigned, bool);
+    using transpose_t = void (*)(const T *, unsigned, T *, unsigned);
+
+    Isa isa;
+    binary_t add, sub;
+    scalar_t add_scalar, scale;
+    unsigned mr, nr;
+    gemm_t gemm;
+    // add, sub, add_scalar and scale with non-temporal stores of the
+    // result, for outputs larger than the last-level cache
+    binary_t add_stream, sub_stream;
+    scalar_t add_scalar_stream, scale_stream;
+    // tile x tile block of a transpose: source, its leading dimension,
+    // destination, its leading dimension
+    unsigned tile;
+    transpose_t transpose;
+
+    static const Kernels &Get() { return Get(ActiveIsa()); }
+    static const Kernels &Get(Isa isa);
+};
+
+template<class T>
+const Kernels<T> &Kernels<T>::Get(Isa isa)
+{
+    static const Kernels portable{Isa::Generic,
+                                  &generic::Add<T>, &generic::Sub<T>,
+                                  &generic::AddScalar<T>, &generic::Scale<T>,
+                                  4, 8, &generic::Gemm<T, 4, 8>,
+                                  &generic::Add<T>, &generic::Sub<T>,
+                                  &generic::AddScalar<T>, &generic::Scale<T>,
+                                  8, &generic::Transpose<T, 8>};
+
+#ifdef MAYKITBO_SIMD_X86
+    if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+    {
+        using S = sse2::Ops<T>;
+        using A2 = avx2::Ops<T>;
+        using A5 = avx512::Ops<T>;
+        switch (isa)
+        {
+            case Isa::SSE2:
+            {
+                static const Kernels kernels{Isa::SSE2,
+                                             &sse2::Add<S>, &sse2::Sub<S>,
+                                             &sse2::AddScalar<S>, &sse2::Scale<S>,
+                                             4, 2 * S::width, &sse2::Gemm<S, 4, 2>,
+                                             &sse2::Add<S, true>, &sse2::Sub<S, true>,
+                                             &sse2::AddScalar<S, true>, &sse2::Scale<S, true>,
+                                             8, &sse2::Transpose<S, 8>};
+                return kernels;
+            }
+            case Isa::AVX2:
+            {
+                static const Kernels kernels{Isa::AVX2,
+                                             &avx2::Add<A2>, &avx2::Sub<A2>,
+                                             &avx2::AddScalar<A2>, &avx2::Scale<A2>,
+                                             6, 2 * A2::width, &avx2::Gemm<A2, 6, 2>,
+                                             &avx2::Add<A2, true>, &avx2::Sub<A2, true>,
+                                             &avx2::AddScalar<A2, true>, &avx2::Scale<A2, true>,
+                                             8, &avx2::Transpose<A2, 8>};
+                return kernels;
+            }
+            case Isa::AVX512:
+            {
+                static const Kernels kernels{Isa::AVX512,
+                                             &avx512::Add<A5>, &avx512::Sub<A5>,
+                                             &avx512::AddScalar<A5>, &avx512::Scale<A5>,
+                                             8, 2 * A5::width, &avx512::Gemm<A5, 8, 2>,
+                                             &avx512::Add<A5, true>, &avx512::Sub<A5, true>,
+                                             &avx512::AddScalar<A5, true>, &avx512::Scale<A5, true>,
+                                             16, &avx512::Transpose<A5, 16>};
+                return kernels;
+            }
+            default:
+                break;
+        }
+    }
+#endif
+    (void)isa;
+    return portable;
+}
+
+} // namespace simd
+
+} // namespace maykitbo
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "cpu.h"
+
+#ifdef MAYKITBO_SIMD_X86
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace maykitbo {
+
+namespace simd {
+
+// Register traits: every member carries the target attribute of its
+// instruction set, so the library itself builds without -m flags and
+// the choice between them is made at runtime. Stream is a non-temporal
+// store past the caches to a register-aligned p, ordered by Fence.
+// Transpose turns width registers, the rows of a square block, into its
+// columns with unpack and lane shuffles.
+
+namespace sse2 {
+
+#define MAYKITBO_SIMD_TARGET __attribute__((target("sse2")))
+
+template<class T> struct Ops;
+
+template<>
+struct Ops<float>
+{
+    using value_t = float;
+    using reg = __m128;
+    static constexpr unsigned width = 4;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm_setzero_ps(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(float v) { return _mm_set1_ps(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const float *p) { return _mm_loadu_ps(p); }
+    MAYKITBO_SIMD_TARGET static void Store(float *p, reg v) { _mm_storeu_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(float *p, reg v) { _mm_stream_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm_add_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r) { _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]); }
+};
+
+template<>
+struct Ops<double>
+{
+    using value_t = double;
+    using reg = __m128d;
+    static constexpr unsigned width = 2;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm_setzero_pd(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(double v) { return _mm_set1_pd(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const double *p) { return _mm_loadu_pd(p); }
+    MAYKITBO_SIMD_TARGET static void Store(double *p, reg v) { _mm_storeu_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(double *p, reg v) { _mm_stream_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm_add_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r)
+    {
+        const reg low = _mm_unpacklo_pd(r[0], r[1]);
+        r[1] = _mm_unpackhi_pd(r[0], r[1]);
+        r[0] = low;
+    }
+};
+
+} // namespace sse2
+
+#define MAYKITBO_SIMD_NS sse2
+#include "x86_kernels.h"
+#undef MAYKITBO_SIMD_NS
+#undef MAYKITBO_SIMD_TARGET
+
+namespace avx2 {
+
+#define MAYKITBO_SIMD_TARGET __attribute__((target("avx2,fma")))
+
+template<class T> struct Ops;
+
+template<>
+struct Ops<float>
+{
+    using value_t = float;
+    using reg = __m256;
+    static constexpr unsigned width = 8;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm256_setzero_ps(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(float v) { return _mm256_set1_ps(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const float *p) { return _mm256_loadu_ps(p); }
+    MAYKITBO_SIMD_TARGET static void Store(float *p, reg v) { _mm256_storeu_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(float *p, reg v) { _mm256_stream_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r)
+    {
+        reg t[8], u[8];
+        for (unsigned i = 0; i < 8; i += 2)
+        {
+            t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+        }
+        for (unsigned i = 0; i < 8; i += 4)
+        {
+            u[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+            u[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        // Lane l of u[4 * g + c]: rows 4g to 4g + 3 of column 4l + c
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            r[c] = _mm256_permute2f128_ps(u[c], u[4 + c], 0x20);
+            r[4 + c] = _mm256_permute2f128_ps(u[c], u[4 + c], 0x31);
+        }
+    }
+};
+
+template<>
+struct Ops<double>
+{
+    using value_t = double;
+    using reg = __m256d;
+    static constexpr unsigned width = 4;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm256_setzero_pd(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(double v) { return _mm256_set1_pd(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const double *p) { return _mm256_loadu_pd(p); }
+    MAYKITBO_SIMD_TARGET static void Store(double *p, reg v) { _mm256_storeu_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(double *p, reg v) { _mm256_stream_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r)
+    {
+        reg t[4];
+        for (unsigned i = 0; i < 4; i += 2)
+        {
+            t[i] = _mm256_unpacklo_pd(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_pd(r[i], r[i + 1]);
+        }
+        // Lane l of t[2 * g + c]: rows 2g and 2g + 1 of column 2l + c
+        for (unsigned c = 0; c < 2; ++c)
+        {
+            r[c] = _mm256_permute2f128_pd(t[c], t[2 + c], 0x20);
+            r[2 + c] = _mm256_permute2f128_pd(t[c], t[2 + c], 0x31);
+        }
+    }
+};
+
+} // namespace avx2
+
+#define MAYKITBO_SIMD_NS avx2
+#include "x86_kernels.h"
+#undef MAYKITBO_SIMD_NS
+#undef MAYKITBO_SIMD_TARGET
+
+namespace avx512 {
+
+#define MAYKITBO_SIMD_TARGET __attribute__((target("avx512f")))
+
+template<class T> struct Ops;
+
+template<>
+struct Ops<float>
+{
+    using value_t = float;
+    using reg = __m512;
+    static constexpr unsigned width = 16;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm512_setzero_ps(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(float v) { return _mm512_set1_ps(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const float *p) { return _mm512_loadu_ps(p); }
+    MAYKITBO_SIMD_TARGET static void Store(float *p, reg v) { _mm512_storeu_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(float *p, reg v) { _mm512_stream_ps(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r)
+    {
+        reg t[16], u[16];
+        for (unsigned i = 0; i < 16; i += 2)
+        {
+            t[i] = _mm512_unpacklo_ps(r[i], r[i + 1]);
+            t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+        }
+        for (unsigned i = 0; i < 16; i += 4)
+        {
+            u[i] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+            u[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+            u[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        // Lane l of u[4 * g + c]: rows 4g to 4g + 3 of column 4l + c
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            const reg even01 = _mm512_shuffle_f32x4(u[c], u[4 + c], _MM_SHUFFLE(2, 0, 2, 0));
+            const reg odd01 = _mm512_shuffle_f32x4(u[c], u[4 + c], _MM_SHUFFLE(3, 1, 3, 1));
+            const reg even23 = _mm512_shuffle_f32x4(u[8 + c], u[12 + c], _MM_SHUFFLE(2, 0, 2, 0));
+            const reg odd23 = _mm512_shuffle_f32x4(u[8 + c], u[12 + c], _MM_SHUFFLE(3, 1, 3, 1));
+            r[c] = _mm512_shuffle_f32x4(even01, even23, _MM_SHUFFLE(2, 0, 2, 0));
+            r[4 + c] = _mm512_shuffle_f32x4(odd01, odd23, _MM_SHUFFLE(2, 0, 2, 0));
+            r[8 + c] = _mm512_shuffle_f32x4(even01, even23, _MM_SHUFFLE(3, 1, 3, 1));
+            r[12 + c] = _mm512_shuffle_f32x4(odd01, odd23, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+    }
+};
+
+template<>
+struct Ops<double>
+{
+    using value_t = double;
+    using reg = __m512d;
+    static constexpr unsigned width = 8;
+    MAYKITBO_SIMD_TARGET static reg Zero() { return _mm512_setzero_pd(); }
+    MAYKITBO_SIMD_TARGET static reg Set1(double v) { return _mm512_set1_pd(v); }
+    MAYKITBO_SIMD_TARGET static reg Load(const double *p) { return _mm512_loadu_pd(p); }
+    MAYKITBO_SIMD_TARGET static void Store(double *p, reg v) { _mm512_storeu_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static void Stream(double *p, reg v) { _mm512_stream_pd(p, v); }
+    MAYKITBO_SIMD_TARGET static reg Add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    MAYKITBO_SIMD_TARGET static reg Fma(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+    MAYKITBO_SIMD_TARGET static void Fence() { _mm_sfence(); }
+    MAYKITBO_SIMD_TARGET static void Transpose(reg *r)
+    {
+        reg t[8];
+        for (unsigned i = 0; i < 8; i += 2)
+        {
+            t[i] = _mm512_unpacklo_pd(r[i], r[i + 1]);
+            t[i + 1] = _mm512_unpackhi_pd(r[i], r[i + 1]);
+        }
+        // Lane l of t[2 * g + c]: rows 2g and 2g + 1 of column 2l + c
+        for (unsigned c = 0; c < 2; ++c)
+        {
+            const reg even01 = _mm512_shuffle_f64x2(t[c], t[2 + c], _MM_SHUFFLE(2, 0, 2, 0));
+            const reg odd01 = _mm512_shuffle_f64x2(t[c], t[2 + c], _MM_SHUFFLE(3, 1, 3, 1));
+            const reg even23 = _mm512_shuffle_f64x2(t[4 + c], t[6 + c], _MM_SHUFFLE(2, 0, 2, 0));
+            const reg odd23 = _mm512_shuffle_f64x2(t[4 + c], t[6 + c], _MM_SHUFFLE(3, 1, 3, 1));
+            r[c] = _mm512_shuffle_f64x2(even01, even23, _MM_SHUFFLE(2, 0, 2, 0));
+            r[2 + c] = _mm512_shuffle_f64x2(odd01, odd23, _MM_SHUFFLE(2, 0, 2, 0));
+            r[4 + c] = _mm512_shuffle_f64x2(even01, even23, _MM_SHUFFLE(3, 1, 3, 1));
+            r[6 + c] = _mm512_shuffle_f64x2(odd01, odd23, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+    }
+};
+
+} // namespace avx512
+
+#define MAYKITBO_SIMD_NS avx512
+#include "x86_kernels.h"
+#undef MAYKITBO_SIMD_NS
+#undef MAYKITBO_SIMD_TARGET
+
+} // namespace simd
+
+} // namespace maykitbo
+
+#endif // MAYKITBO_SIMD_X86
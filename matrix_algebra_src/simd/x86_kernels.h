@@ -0,0 +1,152 @@
+// Kernel bodies shared by every x86 instruction set.
+//
+// Intentionally without #pragma once: x86.h includes this file once per
+// instruction set with MAYKITBO_SIMD_NS naming the namespace and
+// MAYKITBO_SIMD_TARGET the matching target attribute. V is the register
+// traits struct of that namespace (Ops<float> or Ops<double>). With
+// stream the element-wise kernels write c with non-temporal stores.
+
+namespace MAYKITBO_SIMD_NS {
+
+// Elements before the first register-aligned one of c, no more than
+// size: stream stores start there
+template<class V, bool stream>
+MAYKITBO_SIMD_TARGET unsigned Head(unsigned size, const typename V::value_t *c)
+{
+    if (!stream)
+        return 0;
+    constexpr std::uintptr_t bytes = sizeof(typename V::reg);
+    const unsigned head = static_cast<unsigned>(
+        (bytes - reinterpret_cast<std::uintptr_t>(c) % bytes) % bytes / sizeof(*c));
+    return head < size ? head : size;
+}
+
+template<class V, bool stream>
+MAYKITBO_SIMD_TARGET void Put(typename V::value_t *p, typename V::reg v)
+{
+    if constexpr (stream)
+        V::Stream(p, v);
+    else
+        V::Store(p, v);
+}
+
+template<class V, bool stream = false>
+MAYKITBO_SIMD_TARGET void Add(unsigned size, const typename V::value_t *a,
+                              const typename V::value_t *b, typename V::value_t *c)
+{
+    unsigned k = 0;
+    for (const unsigned head = Head<V, stream>(size, c); k < head; ++k)
+        c[k] = a[k] + b[k];
+    for (; k + V::width <= size; k += V::width)
+        Put<V, stream>(c + k, V::Add(V::Load(a + k), V::Load(b + k)));
+    for (; k < size; ++k)
+        c[k] = a[k] + b[k];
+    if constexpr (stream)
+        V::Fence();
+}
+
+template<class V, bool stream = false>
+MAYKITBO_SIMD_TARGET void Sub(unsigned size, const typename V::value_t *a,
+                              const typename V::value_t *b, typename V::value_t *c)
+{
+    unsigned k = 0;
+    for (const unsigned head = Head<V, stream>(size, c); k < head; ++k)
+        c[k] = a[k] - b[k];
+    for (; k + V::width <= size; k += V::width)
+        Put<V, stream>(c + k, V::Sub(V::Load(a + k), V::Load(b + k)));
+    for (; k < size; ++k)
+        c[k] = a[k] - b[k];
+    if constexpr (stream)
+        V::Fence();
+}
+
+template<class V, bool stream = false>
+MAYKITBO_SIMD_TARGET void AddScalar(unsigned size, const typename V::value_t *a,
+                                    typename V::value_t value, typename V::value_t *c)
+{
+    const typename V::reg v = V::Set1(value);
+    unsigned k = 0;
+    for (const unsigned head = Head<V, stream>(size, c); k < head; ++k)
+        c[k] = a[k] + value;
+    for (; k + V::width <= size; k += V::width)
+        Put<V, stream>(c + k, V::Add(V::Load(a + k), v));
+    for (; k < size; ++k)
+        c[k] = a[k] + value;
+    if constexpr (stream)
+        V::Fence();
+}
+
+template<class V, bool stream = false>
+MAYKITBO_SIMD_TARGET void Scale(unsigned size, const typename V::value_t *a,
+                                typename V::value_t value, typename V::value_t *c)
+{
+    const typename V::reg v = V::Set1(value);
+    unsigned k = 0;
+    for (const unsigned head = Head<V, stream>(size, c); k < head; ++k)
+        c[k] = a[k] * value;
+    for (; k + V::width <= size; k += V::width)
+        Put<V, stream>(c + k, V::Mul(V::Load(a + k), v));
+    for (; k < size; ++k)
+        c[k] = a[k] * value;
+    if constexpr (stream)
+        V::Fence();
+}
+
+// MR x (NV * width) register tile, see generic::Gemm
+template<class V, unsigned MR, unsigned NV>
+MAYKITBO_SIMD_TARGET void Gemm(unsigned kc, const typename V::value_t *a,
+                               const typename V::value_t *b, typename V::value_t *c,
+                               unsigned ldc, bool accumulate)
+{
+    using reg = typename V::reg;
+    reg acc[MR][NV];
+    for (unsigned i = 0; i < MR; ++i)
+        for (unsigned j = 0; j < NV; ++j)
+            acc[i][j] = V::Zero();
+
+    for (unsigned p = 0; p < kc; ++p, a += MR, b += NV * V::width)
+    {
+        reg bv[NV];
+        for (unsigned j = 0; j < NV; ++j)
+            bv[j] = V::Load(b + j * V::width);
+        for (unsigned i = 0; i < MR; ++i)
+        {
+            const reg ai = V::Set1(a[i]);
+            for (unsigned j = 0; j < NV; ++j)
+                acc[i][j] = V::Fma(ai, bv[j], acc[i][j]);
+        }
+    }
+
+    for (unsigned i = 0; i < MR; ++i)
+    {
+        typename V::value_t *ci = c + i * ldc;
+        for (unsigned j = 0; j < NV; ++j)
+        {
+            reg r = accumulate ? V::Add(V::Load(ci + j * V::width), acc[i][j]) : acc[i][j];
+            V::Store(ci + j * V::width, r);
+        }
+    }
+}
+
+// tile x tile block d = s^T, turned in width x width squares in the
+// registers, for the V with Transpose
+template<class V, unsigned tile>
+MAYKITBO_SIMD_TARGET void Transpose(const typename V::value_t *s, unsigned lds,
+                                    typename V::value_t *d, unsigned ldd)
+{
+    static_assert(tile % V::width == 0, "tile must be whole registers");
+    for (unsigned bi = 0; bi < tile; bi += V::width)
+    {
+        for (unsigned bj = 0; bj < tile; bj += V::width)
+        {
+            typename V::reg r[V::width];
+            for (unsigned i = 0; i < V::width; ++i)
+                r[i] = V::Load(s + (bi + i) * lds + bj);
+            V::Transpose(r);
+            for (unsigned i = 0; i < V::width; ++i)
+                V::Store(d + (bj + i) * ldd + bi, r[i]);
+        }
+    }
+}
+
+} // namespace MAYKITBO_SIMD_NS
@@ -0,0 +1,609 @@
+#pragma once
+
+#include "../../matrix.h"
+#include "common.h"
+#include "tuning.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+namespace maykitbo {
+
+// Bilinear scheme <m, k, n; rank> for multiplying an m x k grid of blocks
+// of A by a k x n grid of blocks of B:
+//
+//  P_t = (sum_i U[t][i] * A_i) * (sum_j V[t][j] * B_j),  t < rank
+//  C_l = sum_t W[l][t] * P_t
+//
+// Blocks are numbered row by row: A_i is block (i / k, i % k), B_j is
+// (j / n, j % n), C_l is (l / n, l % n).
+struct BilinearScheme
+{
+    std::string name;
+    unsigned m = 0, k = 0, n = 0, rank = 0;
+    std::vector<int> U;   // rank x (m * k)
+    std::vector<int> V;   // rank x (k * n)
+    std::vector<int> W;   // (m * n) x rank
+
+    int u(unsigned t, unsigned i) const { return U[t * m * k + i]; }
+    int v(unsigned t, unsigned j) const { return V[t * k * n + j]; }
+    int w(unsigned l, unsigned t) const { return W[l * rank + t]; }
+
+    // Checks the Brent equations: the scheme computes the product exactly
+    bool Valid() const;
+    // Exponent of the recursion, 3 log(rank) / log(m k n)
+    double Exponent() const { return 3 * std::log(double(rank)) / std::log(double(m * k * n)); }
+
+    // Scheme written as formulas, one product per line of products and
+    // one block of C per line of outputs; blocks are xRC with 1-based
+    // one-digit R and C and an optional integer factor:
+    //
+    //  products: "(a11 + a22) * (b11 + b22)", "a21 * (b12 - 2b22)", ...
+    //  outputs:  "c11 = m1 + m4 - m5 + m7", ...
+    static BilinearScheme Parse(const std::string &name, unsigned m, unsigned k, unsigned n,
+                                const std::vector<std::string> &products,
+                                const std::vector<std::string> &outputs);
+};
+
+namespace schemes {
+
+// m k n products, one per triple
+inline BilinearScheme Classic(unsigned m, unsigned k, unsigned n)
+{
+    BilinearScheme s{"classic", m, k, n, m * k * n, {}, {}, {}};
+    s.U.assign(s.rank * m * k, 0);
+    s.V.assign(s.rank * k * n, 0);
+    s.W.assign(m * n * s.rank, 0);
+    unsigned t = 0;
+    for (unsigned i = 0; i < m; ++i)
+        for (unsigned j = 0; j < n; ++j)
+            for (unsigned p = 0; p < k; ++p, ++t)
+            {
+                s.U[t * m * k + i * k + p] = 1;
+                s.V[t * k * n + p * n + j] = 1;
+                s.W[(i * n + j) * s.rank + t] = 1;
+            }
+    return s;
+}
+
+// Scheme for the product cut along dim ('m', 'k' or 'n') into the part
+// of a and the part of b, e.g. Join(Strassen(), Classic(2, 2, 1), 'n')
+// is <2, 2, 3; 11>. The other two dimensions of a and b must agree.
+inline BilinearScheme Join(const BilinearScheme &a, const BilinearScheme &b, char dim)
+{
+    const bool on_m = dim == 'm', on_k = dim == 'k', on_n = dim == 'n';
+    if ((!on_m && !on_k && !on_n) || (!on_m && a.m != b.m) || (!on_k && a.k != b.k) ||
+        (!on_n && a.n != b.n))
+    {
+        throw std::invalid_argument("BilinearScheme: cannot join " + a.name + " and " + b.name);
+    }
+    BilinearScheme s{a.name + "|" + dim + "|" + b.name,
+                     on_m ? a.m + b.m : a.m, on_k ? a.k + b.k : a.k, on_n ? a.n + b.n : a.n,
+                     a.rank + b.rank, {}, {}, {}};
+    s.U.assign(s.rank * s.m * s.k, 0);
+    s.V.assign(s.rank * s.k * s.n, 0);
+    s.W.assign(s.m * s.n * s.rank, 0);
+    // Block (r, c) of a grid of part x moved past the part of a along dim
+    auto place = [](unsigned r, unsigned c, bool rows, bool cols, unsigned dr, unsigned dc,
+                    unsigned grid_cols)
+    {
+        return (r + (rows ? dr : 0)) * grid_cols + c + (cols ? dc : 0);
+    };
+    const BilinearScheme *parts[2] = {&a, &b};
+    unsigned t0 = 0;
+    for (unsigned part = 0; part < 2; ++part)
+    {
+        const BilinearScheme &x = *parts[part];
+        const unsigned dm = part ? a.m : 0, dk = part ? a.k : 0, dn = part ? a.n : 0;
+        for (unsigned t = 0; t < x.rank; ++t)
+        {
+            for (unsigned i = 0; i < x.m * x.k; ++i)
+                s.U[(t0 + t) * s.m * s.k + place(i / x.k, i % x.k, on_m, on_k, dm, dk, s.k)] = x.u(t, i);
+            for (unsigned j = 0; j < x.k * x.n; ++j)
+                s.V[(t0 + t) * s.k * s.n + place(j / x.n, j % x.n, on_k, on_n, dk, dn, s.n)] = x.v(t, j);
+            for (unsigned l = 0; l < x.m * x.n; ++l)
+                s.W[place(l / x.n, l % x.n, on_m, on_n, dm, dn, s.n) * s.rank + t0 + t] = x.w(l, t);
+        }
+        t0 += x.rank;
+    }
+    return s;
+}
+
+inline const BilinearScheme &Strassen()
+{
+    static const BilinearScheme s = BilinearScheme::Parse("strassen", 2, 2, 2,
+        {"(a11 + a22) * (b11 + b22)", "(a21 + a22) * b11", "a11 * (b12 - b22)",
+         "a22 * (b21 - b11)", "(a11 + a12) * b22", "(a21 - a11) * (b11 + b12)",
+         "(a12 - a22) * (b21 + b22)"},
+        {"c11 = m1 + m4 - m5 + m7", "c12 = m3 + m5", "c21 = m2 + m4",
+         "c22 = m1 - m2 + m3 + m6"});
+    return s;
+}
+
+// The variant of Winograd::PointerBase
+inline const BilinearScheme &Winograd()
+{
+    static const BilinearScheme s = BilinearScheme::Parse("winograd", 2, 2, 2,
+        {"a11 * b11", "a12 * b21", "(a11 + a12 - a21 - a22) * b22",
+         "a22 * (b11 - b12 - b21 + b22)", "(a21 + a22) * (b12 - b11)",
+         "(a21 + a22 - a11) * (b11 - b12 + b22)", "(a11 - a21) * (b22 - b12)"},
+        {"c11 = m1 + m2", "c12 = m1 + m3 + m5 + m6", "c21 = m1 - m4 + m6 + m7",
+         "c22 = m1 + m5 + m6 + m7"});
+    return s;
+}
+
+// Laderman (1976), <3, 3, 3; 23>
+inline const BilinearScheme &Laderman()
+{
+    static const BilinearScheme s = BilinearScheme::Parse("laderman", 3, 3, 3,
+        {"(a11 + a12 + a13 - a21 - a22 - a32 - a33) * b22",
+         "(a11 - a21) * (b22 - b12)",
+         "a22 * (b12 + b21 + b33 - b11 - b22 - b23 - b31)",
+         "(a21 + a22 - a11) * (b11 - b12 + b22)",
+         "(a21 + a22) * (b12 - b11)",
+         "a11 * b11",
+         "(a31 + a32 - a11) * (b11 - b13 + b23)",
+         "(a31 - a11) * (b13 - b23)",
+         "(a31 + a32) * (b13 - b11)",
+         "(a11 + a12 + a13 - a22 - a23 - a31 - a32) * b23",
+         "a32 * (b13 + b21 + b32 - b11 - b22 - b23 - b31)",
+         "(a32 + a33 - a13) * (b22 + b31 - b32)",
+         "(a13 - a33) * (b22 - b32)",
+         "a13 * b31",
+         "(a32 + a33) * (b32 - b31)",
+         "(a22 + a23 - a13) * (b23 + b31 - b33)",
+         "(a13 - a23) * (b23 - b33)",
+         "(a22 + a23) * (b33 - b31)",
+         "a12 * b21",
+         "a23 * b32",
+         "a21 * b13",
+         "a31 * b12",
+         "a33 * b33"},
+        {"c11 = m6 + m14 + m19",
+         "c12 = m1 + m4 + m5 + m6 + m12 + m14 + m15",
+         "c13 = m6 + m7 + m9 + m10 + m14 + m16 + m18",
+         "c21 = m2 + m3 + m4 + m6 + m14 + m16 + m17",
+         "c22 = m2 + m4 + m5 + m6 + m20",
+         "c23 = m14 + m16 + m17 + m18 + m21",
+         "c31 = m6 + m7 + m8 + m11 + m12 + m13 + m14",
+         "c32 = m12 + m13 + m14 + m15 + m22",
+         "c33 = m6 + m7 + m8 + m9 + m23"});
+    return s;
+}
+
+} // namespace schemes
+
+// Levels of a bilinear recursion, root first. Every product of a level
+// has the same shape, so the tree is a chain: a node is cut by
+// schemes[scheme] into rank children shaped as the next node; the last
+// node has scheme -1 and is one leaf product.
+struct BilinearPlan
+{
+    struct Node
+    {
+        unsigned m, k, n;
+        int scheme;
+        // Model cost of the subtree, 0 when the plan was not costed
+        double cost;
+    };
+
+    std::vector<BilinearScheme> schemes;
+    std::vector<Node> nodes;
+
+    // Same scheme at every level while the smallest dimension is above
+    // cap + 1 and every dimension still fills the grid
+    static BilinearPlan Uniform(unsigned m, unsigned k, unsigned n,
+                                const BilinearScheme &scheme, unsigned cap);
+
+    // One line per level, indented by depth:
+    //  150x300x200 <2,3,2;11> strassen|k|classic x11
+    std::string ToString() const;
+};
+
+// Recursive fast multiplication driven by a BilinearPlan: every level
+// cuts C (M x N) = A (M x K) * B (K x N) into the block grid of its
+// scheme and runs its products one after another. Each product builds
+// its two operand sums, recurses, and adds its W column into the blocks
+// of C, so a level keeps three buffers whatever the rank. Operands that
+// are a single whole block are passed in place; blocks past the edge of
+// an indivisible shape read as zeros and are never written.
+template<class T>
+class Bilinear
+{
+    using M = Matrix<T>;
+    using i_type = unsigned;
+
+    public:
+        Bilinear(i_type m, i_type k, i_type n, const BilinearScheme &scheme,
+                 i_type cap = Tuned<T>().winograd_cap);
+        explicit Bilinear(const BilinearPlan &plan);
+        void Execute(const M &A, const M &B, M &C);
+        static void Mul(const M &A, const M &B, M &C, const BilinearScheme &scheme,
+                        i_type cap = Tuned<T>().winograd_cap);
+
+        std::size_t WorkspaceSize() const;
+        // Levels of the scheme above the leaf products
+        unsigned Depth() const { return static_cast<unsigned>(levels_.size()); }
+        const BilinearPlan &Plan() const noexcept { return plan_; }
+
+    private:
+        // Scheme and shape of the parent at one level, its block size,
+        // and the buffers of the level
+        struct Level
+        {
+            const BilinearScheme *scheme;
+            i_type m, k, n;
+            i_type bm, bk, bn;
+            T *SA, *SB, *P;
+        };
+
+        void Run(unsigned depth, const T *A, i_type lda, const T *B, i_type ldb,
+                 T *C, i_type ldc);
+        // Sum of the blocks of X picked by coef into S (rows x cols), or
+        // the only whole block in place; returns the operand and its ld
+        const T *Combine(const int *coef, unsigned grid_cols, unsigned blocks,
+                         const T *X, i_type ldx, i_type rows, i_type cols,
+                         i_type b_rows, i_type b_cols, T *S, i_type &ld) const;
+
+        BilinearPlan plan_;
+        i_type m_, k_, n_;
+        std::vector<Level> levels_;
+        Workspace<T> workspace_;
+};
+
+inline bool BilinearScheme::Valid() const
+{
+    if (U.size() != rank * m * k || V.size() != rank * k * n || W.size() != m * n * rank)
+        return false;
+    // sum_t U[t][(i,p)] V[t][(q,j)] W[(r,s)][t] = [p == q][i == r][j == s]
+    for (unsigned a = 0; a < m * k; ++a)
+        for (unsigned b = 0; b < k * n; ++b)
+            for (unsigned c = 0; c < m * n; ++c)
+            {
+                long sum = 0;
+                for (unsigned t = 0; t < rank; ++t)
+                    sum += long(u(t, a)) * v(t, b) * w(c, t);
+                bool expected = (a % k == b / n) && (a / k == c / n) && (b % n == c % n);
+                if (sum != (expected ? 1 : 0))
+                    return false;
+            }
+    return true;
+}
+
+inline BilinearScheme BilinearScheme::Parse(const std::string &name,
+                                            unsigned m, unsigned k, unsigned n,
+                                            const std::vector<std::string> &products,
+                                            const std::vector<std::string> &outputs)
+{
+    BilinearScheme s{name, m, k, n, static_cast<unsigned>(products.size()), {}, {}, {}};
+    s.U.assign(s.rank * m * k, 0);
+    s.V.assign(s.rank * k * n, 0);
+    s.W.assign(m * n * s.rank, 0);
+    auto fail = [&name](const std::string &what)
+    {
+        throw std::invalid_argument("BilinearScheme " + name + ": cannot parse \"" + what + "\"");
+    };
+
+    // Signed terms "[+-][factor]<letter><index>" of text into the row of
+    // coefficients; index is two digits RC, or the product number for 'm'
+    auto terms = [&fail](const std::string &text, char letter, unsigned rows, unsigned cols,
+                         int *row)
+    {
+        std::size_t i = 0;
+        bool any = false;
+        while (i < text.size())
+        {
+            while (i < text.size() && (std::isspace((unsigned char)text[i]) || text[i] == '(' ||
+                                       text[i] == ')'))
+                ++i;
+            if (i == text.size())
+                break;
+            int sign = 1;
+            if (text[i] == '+' || text[i] == '-')
+            {
+                sign = (text[i] == '-' ? -1 : 1);
+                ++i;
+                while (i < text.size() && std::isspace((unsigned char)text[i]))
+                    ++i;
+            }
+            int factor = 0;
+            while (i < text.size() && std::isdigit((unsigned char)text[i]))
+                factor = factor * 10 + (text[i++] - '0');
+            if (i == text.size() || text[i] != letter)
+                fail(text);
+            ++i;
+            unsigned index = 0, digits = 0;
+            for (; i < text.size() && std::isdigit((unsigned char)text[i]); ++i, ++digits)
+                index = index * 10 + (text[i] - '0');
+            unsigned slot;
+            if (letter == 'm')
+            {
+                if (digits == 0 || index == 0 || index > cols)
+                    fail(text);
+                slot = index - 1;
+            }
+            else
+            {
+                unsigned r = index / 10, c = index % 10;
+                if (digits != 2 || r == 0 || c == 0 || r > rows || c > cols)
+                    fail(text);
+                slot = (r - 1) * cols + (c - 1);
+            }
+            row[slot] += sign * (factor == 0 ? 1 : factor);
+            any = true;
+        }
+        if (!any)
+            fail(text);
+    };
+
+    for (unsigned t = 0; t < s.rank; ++t)
+    {
+        const std::string &p = products[t];
+        int depth = 0;
+        std::size_t star = std::string::npos;
+        for (std::size_t i = 0; i < p.size(); ++i)
+        {
+            depth += (p[i] == '(') - (p[i] == ')');
+            if (p[i] == '*' && depth == 0)
+                star = i;
+        }
+        if (star == std::string::npos)
+            fail(p);
+        terms(p.substr(0, star), 'a', m, k, &s.U[t * m * k]);
+        terms(p.substr(star + 1), 'b', k, n, &s.V[t * k * n]);
+    }
+    if (outputs.size() != m * n)
+        fail(name);
+    std::vector<bool> seen(m * n, false);
+    for (const std::string &o : outputs)
+    {
+        std::size_t eq = o.find('=');
+        std::size_t c = o.find('c');
+        if (eq == std::string::npos || c == std::string::npos || c + 2 >= eq)
+            fail(o);
+        unsigned r = o[c + 1] - '0', col = o[c + 2] - '0';
+        if (r == 0 || col == 0 || r > m || col > n || seen[(r - 1) * n + col - 1])
+            fail(o);
+        unsigned l = (r - 1) * n + col - 1;
+        seen[l] = true;
+        terms(o.substr(eq + 1), 'm', 1, s.rank, &s.W[l * s.rank]);
+    }
+    return s;
+}
+
+inline BilinearPlan BilinearPlan::Uniform(unsigned m, unsigned k, unsigned n,
+                                          const BilinearScheme &scheme, unsigned cap)
+{
+    BilinearPlan plan{{scheme}, {}};
+    while (std::min({m, k, n}) > cap + 1 && m >= scheme.m && k >= scheme.k && n >= scheme.n)
+    {
+        plan.nodes.push_back({m, k, n, 0, 0});
+        m = (m + scheme.m - 1) / scheme.m;
+        k = (k + scheme.k - 1) / scheme.k;
+        n = (n + scheme.n - 1) / scheme.n;
+    }
+    plan.nodes.push_back({m, k, n, -1, 0});
+    return plan;
+}
+
+inline std::string BilinearPlan::ToString() const
+{
+    std::string out;
+    for (std::size_t depth = 0; depth < nodes.size(); ++depth)
+    {
+        const Node &node = nodes[depth];
+        out += std::string(2 * depth, ' ') + std::to_string(node.m) + 'x' +
+               std::to_string(node.k) + 'x' + std::to_string(node.n);
+        if (node.scheme < 0)
+        {
+            out += " leaf";
+        }
+        else
+        {
+            const BilinearScheme &s = schemes[node.scheme];
+            out += " <" + std::to_string(s.m) + ',' + std::to_string(s.k) + ',' +
+                   std::to_string(s.n) + ';' + std::to_string(s.rank) + "> " + s.name +
+                   " x" + std::to_string(s.rank);
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+template<class T>
+Bilinear<T>::Bilinear(i_type m, i_type k, i_type n, const BilinearScheme &scheme, i_type cap)
+    : Bilinear(BilinearPlan::Uniform(m, k, n, scheme, cap))
+{
+}
+
+template<class T>
+Bilinear<T>::Bilinear(const BilinearPlan &plan)
+    : plan_(plan)
+{
+    if (plan.nodes.empty() || plan.nodes.back().scheme >= 0)
+        throw std::invalid_argument("BilinearPlan must end in a leaf");
+    m_ = plan.nodes.front().m;
+    k_ = plan.nodes.front().k;
+    n_ = plan.nodes.front().n;
+    if (m_ == 0 || k_ == 0 || n_ == 0)
+        throw std::invalid_argument("Matrix size must be greater than 0");
+    for (const BilinearScheme &scheme : plan_.schemes)
+    {
+        if (!scheme.Valid())
+            throw std::invalid_argument("BilinearScheme " + scheme.name + " is not a valid scheme");
+    }
+
+    for (std::size_t depth = 0; depth + 1 < plan_.nodes.size(); ++depth)
+    {
+        const BilinearPlan::Node &node = plan_.nodes[depth], &child = plan_.nodes[depth + 1];
+        if (node.scheme < 0 || std::size_t(node.scheme) >= plan_.schemes.size())
+            throw std::invalid_argument("BilinearPlan has a leaf above the last level");
+        const BilinearScheme &scheme = plan_.schemes[node.scheme];
+        Level level{&scheme, node.m, node.k, node.n,
+                    (node.m + scheme.m - 1) / scheme.m,
+                    (node.k + scheme.k - 1) / scheme.k,
+                    (node.n + scheme.n - 1) / scheme.n,
+                    nullptr, nullptr, nullptr};
+        if (node.m < scheme.m || node.k < scheme.k || node.n < scheme.n ||
+            child.m != level.bm || child.k != level.bk || child.n != level.bn)
+        {
+            throw std::invalid_argument("BilinearPlan levels do not match their schemes");
+        }
+        levels_.push_back(level);
+    }
+    T *ws = workspace_.Reserve(WorkspaceSize());
+    for (Level &level : levels_)
+    {
+        level.SA = ws;
+        level.SB = level.SA + Workspace<T>::Round(level.bm * level.bk);
+        level.P = level.SB + Workspace<T>::Round(level.bk * level.bn);
+        ws = level.P + Workspace<T>::Round(level.bm * level.bn);
+    }
+}
+
+template<class T>
+std::size_t Bilinear<T>::WorkspaceSize() const
+{
+    using W = Workspace<T>;
+    std::size_t size = 0;
+    for (const Level &level : levels_)
+        size += W::Round(level.bm * level.bk) + W::Round(level.bk * level.bn) +
+                W::Round(level.bm * level.bn);
+    return size;
+}
+
+template<class T>
+void Bilinear<T>::Mul(const M &A, const M &B, M &C, const BilinearScheme &scheme, i_type cap)
+{
+    Bilinear<T>(A.GetRows(), A.GetCols(), B.GetCols(), scheme, cap).Execute(A, B, C);
+}
+
+template<class T>
+void Bilinear<T>::Execute(const M &A, const M &B, M &C)
+{
+    if (A.GetRows() != m_ || A.GetCols() != k_ || B.GetRows() != k_ ||
+        B.GetCols() != n_ || C.GetRows() != m_ || C.GetCols() != n_)
+    {
+        throw std::invalid_argument("Matrix size not match");
+    }
+    Run(0, A.Data(), k_, B.Data(), n_, C.Data(), n_);
+}
+
+template<class T>
+const T *Bilinear<T>::Combine(const int *coef, unsigned grid_cols, unsigned blocks,
+                              const T *X, i_type ldx, i_type rows, i_type cols,
+                              i_type b_rows, i_type b_cols, T *S, i_type &ld) const
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    auto valid = [&](unsigned i, i_type &r, i_type &c)
+    {
+        i_type r0 = (i / grid_cols) * b_rows, c0 = (i % grid_cols) * b_cols;
+        r = r0 < rows ? std::min(b_rows, rows - r0) : 0;
+        c = c0 < cols ? std::min(b_cols, cols - c0) : 0;
+        return X + r0 * ldx + c0;
+    };
+
+    unsigned used = 0, only = 0;
+    for (unsigned i = 0; i < blocks; ++i)
+    {
+        if (coef[i] != 0)
+        {
+            ++used;
+            only = i;
+        }
+    }
+    i_type r, c;
+    const T *block = valid(only, r, c);
+    if (used == 1 && coef[only] == 1 && r == b_rows && c == b_cols)
+    {
+        ld = ldx;
+        return block;
+    }
+
+    std::fill(S, S + b_rows * b_cols, T());
+    for (unsigned i = 0; i < blocks; ++i)
+    {
+        const int a = coef[i];
+        if (a == 0)
+            continue;
+        block = valid(i, r, c);
+        for (i_type row = 0; row < r; ++row)
+        {
+            const T *x = block + row * ldx;
+            T *s = S + row * b_cols;
+            if (a == 1)
+                K.add(c, s, x, s);
+            else if (a == -1)
+                K.sub(c, s, x, s);
+            else
+                for (i_type j = 0; j < c; ++j)
+                    s[j] += T(a) * x[j];
+        }
+    }
+    ld = b_cols;
+    return S;
+}
+
+template<class T>
+void Bilinear<T>::Run(unsigned depth, const T *A, i_type lda, const T *B, i_type ldb,
+                      T *C, i_type ldc)
+{
+    if (depth == levels_.size())
+    {
+        const BilinearPlan::Node &leaf = plan_.nodes.back();
+        LeafProduct<T>::Mul(leaf.m, leaf.n, leaf.k, A, lda, B, ldb, C, ldc);
+        return;
+    }
+    const BilinearScheme &s = *levels_[depth].scheme;
+    const Level &L = levels_[depth];
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+
+    // Blocks of C are written by the first product that uses them
+    std::vector<bool> written(s.m * s.n, false);
+    for (unsigned t = 0; t < s.rank; ++t)
+    {
+        i_type lsa, lsb;
+        const T *a = Combine(&s.U[t * s.m * s.k], s.k, s.m * s.k, A, lda, L.m, L.k,
+                             L.bm, L.bk, L.SA, lsa);
+        const T *b = Combine(&s.V[t * s.k * s.n], s.n, s.k * s.n, B, ldb, L.k, L.n,
+                             L.bk, L.bn, L.SB, lsb);
+        Run(depth + 1, a, lsa, b, lsb, L.P, L.bn);
+
+        for (unsigned l = 0; l < s.m * s.n; ++l)
+        {
+            const int w = s.w(l, t);
+            if (w == 0)
+                continue;
+            i_type r0 = (l / s.n) * L.bm, c0 = (l % s.n) * L.bn;
+            if (r0 >= L.m || c0 >= L.n)
+                continue;
+            i_type r = std::min(L.bm, L.m - r0), c = std::min(L.bn, L.n - c0);
+            for (i_type row = 0; row < r; ++row)
+            {
+                T *z = C + (r0 + row) * ldc + c0;
+                const T *p = L.P + row * L.bn;
+                if (!written[l])
+                {
+                    if (w == 1)
+                        std::copy(p, p + c, z);
+                    else
+                        K.scale(c, p, T(w), z);
+                }
+                else if (w == 1)
+                    K.add(c, z, p, z);
+                else if (w == -1)
+                    K.sub(c, z, p, z);
+                else
+                    for (i_type j = 0; j < c; ++j)
+                        z[j] += T(w) * p[j];
+            }
+            written[l] = true;
+        }
+    }
+}
+
+} // namespace maykitbo
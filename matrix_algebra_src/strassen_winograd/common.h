@@ -0,0 +1,454 @@
+#pragma once
+
+#include "../simd/kernels.h"
+#include "leaf.h"
+
+#include <algorithm>
+#include <vector>
+#include <array>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <cstdint>
+
+namespace maykitbo {
+
+// Single 64-byte aligned arena holding every level buffer of a plan.
+// Levels take consecutive slices of it, each slice rounded so the next
+// one stays aligned.
+template<class T>
+class Workspace
+{
+    public:
+        static constexpr std::size_t alignment = 64;
+
+        Workspace() = default;
+        explicit Workspace(std::size_t size) { Reserve(size); }
+
+        // Grows the arena to at least size elements, contents are dropped
+        T *Reserve(std::size_t size)
+        {
+            if (size > size_)
+            {
+                data_.reset(static_cast<T *>(
+                    ::operator new[](size * sizeof(T), std::align_val_t(alignment))));
+                size_ = size;
+            }
+            return data_.get();
+        }
+
+        T *Data() const { return data_.get(); }
+        std::size_t Size() const { return size_; }
+
+        // Elements to take for a buffer of size elements
+        static constexpr std::size_t Round(std::size_t size)
+        {
+            const std::size_t step = alignment / std::gcd(alignment, sizeof(T));
+            return (size + step - 1) / step * step;
+        }
+
+        static void CheckAligned(const T *data)
+        {
+            if (data == nullptr || reinterpret_cast<std::uintptr_t>(data) % alignment != 0)
+                throw std::invalid_argument("Workspace must be 64-byte aligned");
+        }
+
+    private:
+        struct Free
+        {
+            void operator()(T *data) const
+            {
+                ::operator delete[](data, std::align_val_t(alignment));
+            }
+        };
+
+        std::unique_ptr<T, Free> data_;
+        std::size_t size_ = 0;
+};
+
+// Thread-safe LRU cache of ready plans for the static Mul entry points.
+// A plan is taken out of the cache for the time of one product, so two
+// threads multiplying the same shape never share buffers; the cache keeps
+// as many plans per key as were in use at once. Plans are dropped least
+// recently used first while their workspaces exceed the limit in bytes.
+template<class Plan>
+class PlanCache
+{
+    public:
+        // Shape, caps and threads the plan runs on, unused fields are 0
+        using Key = std::array<unsigned, 6>;
+
+        static constexpr std::size_t default_limit = std::size_t(256) << 20;
+
+        explicit PlanCache(std::size_t limit = default_limit) : limit_(limit) {}
+
+        // Cached plan for key removed from the cache, or nullptr
+        std::unique_ptr<Plan> Take(const Key &key)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(key);
+            if (found == index_.end())
+                return nullptr;
+            auto entry = found->second;
+            index_.erase(found);
+            std::unique_ptr<Plan> plan = std::move(entry->plan);
+            bytes_ -= entry->bytes;
+            lru_.erase(entry);
+            return plan;
+        }
+
+        // Puts a plan back as the most recently used one
+        void Give(const Key &key, std::unique_ptr<Plan> plan, std::size_t bytes)
+        {
+            std::list<Entry> dropped;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (bytes > limit_)
+                return;
+            lru_.push_front(Entry{key, std::move(plan), bytes});
+            index_.emplace(key, lru_.begin());
+            bytes_ += bytes;
+            Shrink(dropped);
+        }
+
+        void SetLimit(std::size_t limit)
+        {
+            std::list<Entry> dropped;
+            std::lock_guard<std::mutex> lock(mutex_);
+            limit_ = limit;
+            Shrink(dropped);
+        }
+
+        void Clear()
+        {
+            std::list<Entry> dropped;
+            std::lock_guard<std::mutex> lock(mutex_);
+            index_.clear();
+            dropped.swap(lru_);
+            bytes_ = 0;
+        }
+
+        std::size_t Limit() const { std::lock_guard<std::mutex> lock(mutex_); return limit_; }
+        std::size_t Bytes() const { std::lock_guard<std::mutex> lock(mutex_); return bytes_; }
+        std::size_t Size() const { std::lock_guard<std::mutex> lock(mutex_); return lru_.size(); }
+
+    private:
+        struct Entry
+        {
+            Key key;
+            std::unique_ptr<Plan> plan;
+            std::size_t bytes;
+        };
+
+        // Evicted plans are moved to dropped and freed after the lock
+        void Shrink(std::list<Entry> &dropped)
+        {
+            while (bytes_ > limit_)
+            {
+                auto last = std::prev(lru_.end());
+                auto range = index_.equal_range(last->key);
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (it->second == last)
+                    {
+                        index_.erase(it);
+                        break;
+                    }
+                }
+                bytes_ -= last->bytes;
+                dropped.splice(dropped.begin(), lru_, last);
+            }
+        }
+
+        mutable std::mutex mutex_;
+        std::list<Entry> lru_;
+        std::multimap<Key, typename std::list<Entry>::iterator> index_;
+        std::size_t bytes_ = 0;
+        std::size_t limit_;
+};
+
+// Row access to the four quadrants of a parent matrix for the forward and
+// backward phases of the 2x2 recursive levels.
+//
+// The parent has real size rows x cols, leading dimension ld, and is split
+// into quadrants of
+// h_rows x h_cols with rows <= 2 * h_rows and cols <= 2 * h_cols. Every
+// callback gets the matching parent row of the top (X11 | X12) and bottom
+// (X21 | X22) half, 2 * h_cols long, and the offset of that row inside a
+// quadrant-sized buffer. Where the parent is short the callback works on
+// zero-padded scratch rows instead, so the level formulas never see the
+// padding.
+template<class T>
+struct Quadrants
+{
+    using i_type = unsigned;
+
+    template<class F>
+    static void Read(const T *P, i_type ld, i_type rows, i_type cols,
+                     i_type h_rows, i_type h_cols,
+                     i_type from, i_type to, F row)
+    {
+        const i_type width = h_cols * 2;
+        std::vector<T> scratch;
+        for (i_type i = from; i < to; ++i)
+        {
+            const T *top = P + i * ld;
+            const T *bottom = P + (i + h_rows) * ld;
+            bool bottom_real = (i + h_rows < rows);
+            if (cols != width || !bottom_real)
+            {
+                scratch.assign(width * 2, T());
+                std::copy(top, top + cols, scratch.begin());
+                if (bottom_real)
+                    std::copy(bottom, bottom + cols, scratch.begin() + width);
+                top = scratch.data();
+                bottom = scratch.data() + width;
+            }
+            row(top, bottom, i * h_cols);
+        }
+    }
+
+    template<class F>
+    static void Write(T *P, i_type ld, i_type rows, i_type cols,
+                      i_type h_rows, i_type h_cols,
+                      i_type from, i_type to, F row)
+    {
+        const i_type width = h_cols * 2;
+        std::vector<T> scratch;
+        for (i_type i = from; i < to; ++i)
+        {
+            T *top = P + i * ld;
+            T *bottom = P + (i + h_rows) * ld;
+            bool bottom_real = (i + h_rows < rows);
+            if (cols == width && bottom_real)
+            {
+                row(top, bottom, i * h_cols);
+                continue;
+            }
+            scratch.resize(width * 2);
+            row(scratch.data(), scratch.data() + width, i * h_cols);
+            std::copy(scratch.begin(), scratch.begin() + cols, top);
+            if (bottom_real)
+                std::copy(scratch.begin() + width, scratch.begin() + width + cols, bottom);
+        }
+    }
+};
+
+// Classic split of one dimension of C (m x n) = A (m x k) * B (k x n) in
+// two, for shapes too unbalanced for a 2x2x2 step to pay off.
+// Halves are size h and (dim - h); next multiplies the first one and
+// next2 the second one (the same level when both halves are equal).
+// Halves are windows of the parent, only a K split needs a buffer for
+// the second partial product.
+template<class T, class Level>
+struct SplitLevel : public Level
+{
+    using i_type = unsigned;
+    enum Dim { M, K, N };
+
+    Dim dim;
+    i_type m, k, n, h;
+    Level *next2;
+    T *Y = nullptr;
+
+    SplitLevel(Dim dim, i_type m, i_type k, i_type n)
+        : dim(dim)
+        , m(m)
+        , k(k)
+        , n(n)
+        , h(((dim == M ? m : dim == K ? k : n) + 1) / 2)
+    {}
+
+    std::size_t Size() const override
+    {
+        return dim == K ? Workspace<T>::Round(m * n) : 0;
+    }
+
+    T *Bind(T *ws) override
+    {
+        if (dim != K)
+            return ws;
+        Y = ws;
+        return ws + Workspace<T>::Round(m * n);
+    }
+
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override
+    {
+        if (dim == M)
+        {
+            this->next->SW(A, lda, B, ldb, C, ldc);
+            next2->SW(A + h * lda, lda, B, ldb, C + h * ldc, ldc);
+        }
+        else if (dim == N)
+        {
+            this->next->SW(A, lda, B, ldb, C, ldc);
+            next2->SW(A, lda, B + h, ldb, C + h, ldc);
+        }
+        else
+        {
+            this->next->SW(A, lda, B, ldb, C, ldc);
+            next2->SW(A + h, lda, B + h * ldb, ldb, Y, n);
+            const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+            for (i_type i = 0; i < m; ++i)
+                K.add(n, C + i * ldc, Y + i * n, C + i * ldc);
+        }
+    }
+
+    // Dimension worth splitting classically, or false when the shape is
+    // balanced enough for a 2x2x2 step.
+    static bool Unbalanced(i_type m, i_type k, i_type n, Dim &dim)
+    {
+        i_type lo = std::min({m, k, n});
+        i_type hi = std::max({m, k, n});
+        if (hi < lo * 2)
+            return false;
+        dim = (hi == m ? M : hi == n ? N : K);
+        return true;
+    }
+
+    // Shapes of the two halves along dim
+    static void Halves(Dim dim, i_type m, i_type k, i_type n,
+                       i_type (&first)[3], i_type (&second)[3])
+    {
+        i_type d[3] = {m, k, n};
+        i_type h = (d[dim] + 1) / 2;
+        std::copy(d, d + 3, first);
+        std::copy(d, d + 3, second);
+        first[dim] = h;
+        second[dim] = d[dim] - h;
+    }
+};
+
+// Products under the last parallel level of WinogradP and StrassenP: they
+// all have one shape and run to the end on the thread that starts them,
+// so rather than a subtree of buffers each they share copies of one
+// sequential subtree, a copy per thread of the pool. A product takes the
+// copy of its thread, else any free one; it waits for one only when
+// threads from outside the pool help with the tasks.
+template<class T, class Level>
+struct SharedLevel : public Level
+{
+    using i_type = unsigned;
+
+    i_type m, k, n;
+    parallel::ThreadPool *pool;
+    std::vector<Level *> copies;
+    std::vector<char> busy;
+    std::mutex mutex;
+    std::condition_variable freed;
+
+    SharedLevel(i_type m, i_type k, i_type n, parallel::ThreadPool *pool)
+        : m(m), k(k), n(n), pool(pool)
+    {}
+
+    void Add(Level *copy)
+    {
+        copies.push_back(copy);
+        busy.push_back(false);
+    }
+
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override
+    {
+        const std::size_t copy = Acquire();
+        try
+        {
+            copies[copy]->SW(A, lda, B, ldb, C, ldc);
+        }
+        catch (...)
+        {
+            Release(copy);
+            throw;
+        }
+        Release(copy);
+    }
+
+    std::size_t Acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::size_t copy = pool->Self();
+        while (copy >= busy.size() || busy[copy])
+        {
+            copy = std::find(busy.begin(), busy.end(), false) - busy.begin();
+            if (copy == busy.size())
+                freed.wait(lock);
+        }
+        busy[copy] = true;
+        return copy;
+    }
+
+    void Release(std::size_t copy)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy[copy] = false;
+        }
+        freed.notify_one();
+    }
+};
+
+// Dynamic peeling of C (m x n) = A (m x k) * B (k x n): next multiplies
+// the pm x pk x pn core, the leftover border is fixed up with leaf
+// products straight on the parent
+//
+//   C[0:pm, 0:pn] += A[0:pm, pk:k] * B[pk:k, 0:pn]   rank-(k - pk) update
+//   C[0:pm, pn:n]  = A[0:pm, :] * B[:, pn:n]         last columns
+//   C[pm:m, :]     = A[pm:m, :] * B                  last rows
+//
+// The level needs no buffer.
+template<class T, class Level>
+struct PeelLevel : public Level
+{
+    using i_type = unsigned;
+
+    static constexpr double border_cost = 4;
+
+    i_type m, k, n;
+    i_type pm, pk, pn;
+
+    PeelLevel(i_type m, i_type k, i_type n, i_type pm, i_type pk, i_type pn)
+        : m(m), k(k), n(n), pm(pm), pk(pk), pn(pn)
+    {}
+
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override
+    {
+        this->next->SW(A, lda, B, ldb, C, ldc);
+        if (pk < k)
+            LeafProduct<T>::Mul(pm, pn, k - pk, A + pk, lda, B + pk * ldb, ldb, C, ldc, true);
+        if (pn < n)
+            LeafProduct<T>::Mul(pm, n - pn, k, A, lda, B + pn, ldb, C + pn, ldc);
+        if (pm < m)
+            LeafProduct<T>::Mul(m - pm, n, k, A + pm * lda, lda, B, ldb, C + pm * ldc, ldc);
+    }
+
+    // Chooses between padding m x k x n up to multiples of step and
+    // peeling it down to them, for a core that recurses depth more
+    // levels. A level saves 1/8 of the multiply-adds; the border is a few
+    // rows and columns thick, so it runs memory-bound at about a quarter
+    // of the speed of a blocked product. Fills core and returns true when
+    // peeling is cheaper.
+    static bool Cheaper(i_type m, i_type k, i_type n, i_type step, unsigned depth,
+                        i_type (&core)[3])
+    {
+        const i_type d[3] = {m, k, n};
+        double padded = 1, peeled = 1, real = 1;
+        for (int i = 0; i < 3; ++i)
+        {
+            core[i] = d[i] / step * step;
+            if (core[i] == 0)
+                return false;
+            padded *= (d[i] + step - 1) / step * step;
+            peeled *= core[i];
+            real *= d[i];
+        }
+        double rate = 1;
+        for (unsigned i = 0; i < depth; ++i)
+            rate *= 7.0 / 8.0;
+        return peeled * rate + (real - peeled) * border_cost < padded * rate;
+    }
+};
+
+} // namespace maykitbo
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "../../matrix.h"
+#include "common.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+namespace maykitbo {
+
+namespace fixed {
+
+using i_type = unsigned;
+
+// One 2x2x2 level of a product whose shape is a compile-time constant:
+// C (M x N) = A (M x K) * B (K x N). Shapes below Cap + 1 are a leaf;
+// every level above must halve exactly, so quadrants are always read in
+// place and only the sums and products get buffers.
+//
+// Scheme provides the a_sums and b_sums buffer counts, Forward (one fused
+// pass over the quadrants of A and of B), Products and Backward (one fused
+// pass writing the quadrants of C).
+template<class T, class Scheme, i_type M, i_type K, i_type N, i_type Cap>
+struct Step
+{
+    static constexpr i_type m = M / 2, k = K / 2, n = N / 2;
+    static constexpr bool leaf = std::min({M, K, N}) <= Cap + 1;
+    using Next = Step<T, Scheme, m, k, n, Cap>;
+
+    static constexpr std::size_t Own()
+    {
+        using W = Workspace<T>;
+        return W::Round(m * k) * Scheme::a_sums + W::Round(k * n) * Scheme::b_sums +
+               W::Round(m * n) * 7;
+    }
+
+    // Workspace of this level and every level below it; the seven
+    // products of a level run one after another and share the rest
+    static constexpr std::size_t Size()
+    {
+        if constexpr (leaf)
+            return 0;
+        else
+            return Own() + Next::Size();
+    }
+
+    static void Run(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc, T *ws)
+    {
+        if constexpr (leaf)
+        {
+            LeafProduct<T>::Mul(M, N, K, A, lda, B, ldb, C, ldc);
+        }
+        else
+        {
+            static_assert(M % 2 == 0 && K % 2 == 0 && N % 2 == 0,
+                          "Fixed shapes must halve evenly down to the leaf");
+            using W = Workspace<T>;
+            T *S = ws;
+            T *U = S + W::Round(m * k) * Scheme::a_sums;
+            T *R = U + W::Round(k * n) * Scheme::b_sums;
+            T *rest = ws + Own();
+            Scheme::template Forward<T, m, k, n>(A, lda, B, ldb, S, U);
+            Scheme::template Products<T, Next, m, k, n>(A, lda, B, ldb, S, U, R, rest);
+            Scheme::template Backward<T, m, n>(R, C, ldc);
+        }
+    }
+};
+
+// Buffer i of a group of equally sized buffers starting at base
+template<std::size_t Size, class P>
+constexpr P *Buffer(P *base, int i)
+{
+    return base + Workspace<std::remove_const_t<P>>::Round(Size) * i;
+}
+
+// Winograd variant, the formulas of Winograd::PointerBase
+struct WinogradScheme
+{
+    static constexpr int a_sums = 4, b_sums = 4;
+
+    template<class T, i_type m, i_type k, i_type n>
+    static void Forward(const T *A, i_type lda, const T *B, i_type ldb, T *S, T *U)
+    {
+        T *S1 = S, *S2 = Buffer<m * k>(S, 1), *S3 = Buffer<m * k>(S, 2),
+          *S4 = Buffer<m * k>(S, 3);
+        for (i_type i = 0; i < m; ++i)
+        {
+            const T *a11 = A + i * lda, *a12 = a11 + k;
+            const T *a21 = a11 + m * lda, *a22 = a21 + k;
+            const i_type r = i * k;
+            for (i_type j = 0; j < k; ++j)
+            {
+                const T s1 = a21[j] + a22[j];
+                const T s2 = s1 - a11[j];
+                S1[r + j] = s1;
+                S2[r + j] = s2;
+                S3[r + j] = a11[j] - a21[j];
+                S4[r + j] = a12[j] - s2;
+            }
+        }
+        T *T1 = U, *T2 = Buffer<k * n>(U, 1), *T3 = Buffer<k * n>(U, 2),
+          *T4 = Buffer<k * n>(U, 3);
+        for (i_type i = 0; i < k; ++i)
+        {
+            const T *b11 = B + i * ldb, *b12 = b11 + n;
+            const T *b21 = b11 + k * ldb, *b22 = b21 + n;
+            const i_type r = i * n;
+            for (i_type j = 0; j < n; ++j)
+            {
+                const T t1 = b12[j] - b11[j];
+                const T t2 = b22[j] - t1;
+                T1[r + j] = t1;
+                T2[r + j] = t2;
+                T3[r + j] = b22[j] - b12[j];
+                T4[r + j] = t2 - b21[j];
+            }
+        }
+    }
+
+    template<class T, class Next, i_type m, i_type k, i_type n>
+    static void Products(const T *A, i_type lda, const T *B, i_type ldb,
+                         T *S, T *U, T *R, T *ws)
+    {
+        auto s = [S](int i) { return Buffer<m * k>(S, i); };
+        auto t = [U](int i) { return Buffer<k * n>(U, i); };
+        auto r = [R](int i) { return Buffer<m * n>(R, i); };
+        const T *a12 = A + k, *a22 = A + m * lda + k;
+        const T *b21 = B + k * ldb, *b22 = b21 + n;
+        Next::Run(A, lda, B, ldb, r(0), n, ws);
+        Next::Run(a12, lda, b21, ldb, r(1), n, ws);
+        Next::Run(s(3), k, b22, ldb, r(2), n, ws);
+        Next::Run(a22, lda, t(3), n, r(3), n, ws);
+        Next::Run(s(0), k, t(0), n, r(4), n, ws);
+        Next::Run(s(1), k, t(1), n, r(5), n, ws);
+        Next::Run(s(2), k, t(2), n, r(6), n, ws);
+    }
+
+    template<class T, i_type m, i_type n>
+    static void Backward(const T *R, T *C, i_type ldc)
+    {
+        const T *R1 = R, *R2 = Buffer<m * n>(R, 1), *R3 = Buffer<m * n>(R, 2),
+                *R4 = Buffer<m * n>(R, 3), *R5 = Buffer<m * n>(R, 4),
+                *R6 = Buffer<m * n>(R, 5), *R7 = Buffer<m * n>(R, 6);
+        for (i_type i = 0; i < m; ++i)
+        {
+            T *c11 = C + i * ldc, *c12 = c11 + n;
+            T *c21 = c11 + m * ldc, *c22 = c21 + n;
+            const i_type r = i * n;
+            for (i_type j = 0; j < n; ++j)
+            {
+                const T u2 = R1[r + j] + R6[r + j];
+                const T u3 = u2 + R7[r + j];
+                c11[j] = R1[r + j] + R2[r + j];
+                c12[j] = u2 + R5[r + j] + R3[r + j];
+                c21[j] = u3 - R4[r + j];
+                c22[j] = u3 + R5[r + j];
+            }
+        }
+    }
+};
+
+// Strassen variant, the formulas of Strassen::PointerBase
+struct StrassenScheme
+{
+    static constexpr int a_sums = 5, b_sums = 5;
+
+    template<class T, i_type m, i_type k, i_type n>
+    static void Forward(const T *A, i_type lda, const T *B, i_type ldb, T *S, T *U)
+    {
+        T *P = S, *S1 = Buffer<m * k>(S, 1), *S2 = Buffer<m * k>(S, 2),
+          *S3 = Buffer<m * k>(S, 3), *S4 = Buffer<m * k>(S, 4);
+        for (i_type i = 0; i < m; ++i)
+        {
+            const T *a11 = A + i * lda, *a12 = a11 + k;
+            const T *a21 = a11 + m * lda, *a22 = a21 + k;
+            const i_type r = i * k;
+            for (i_type j = 0; j < k; ++j)
+            {
+                P[r + j] = a11[j] + a22[j];
+                S1[r + j] = a21[j] + a22[j];
+                S2[r + j] = a11[j] + a12[j];
+                S3[r + j] = a21[j] - a11[j];
+                S4[r + j] = a12[j] - a22[j];
+            }
+        }
+        T *Q = U, *T1 = Buffer<k * n>(U, 1), *T2 = Buffer<k * n>(U, 2),
+          *T3 = Buffer<k * n>(U, 3), *T4 = Buffer<k * n>(U, 4);
+        for (i_type i = 0; i < k; ++i)
+        {
+            const T *b11 = B + i * ldb, *b12 = b11 + n;
+            const T *b21 = b11 + k * ldb, *b22 = b21 + n;
+            const i_type r = i * n;
+            for (i_type j = 0; j < n; ++j)
+            {
+                Q[r + j] = b11[j] + b22[j];
+                T1[r + j] = b12[j] - b22[j];
+                T2[r + j] = b21[j] - b11[j];
+                T3[r + j] = b11[j] + b12[j];
+                T4[r + j] = b21[j] + b22[j];
+            }
+        }
+    }
+
+    template<class T, class Next, i_type m, i_type k, i_type n>
+    static void Products(const T *A, i_type lda, const T *B, i_type ldb,
+                         T *S, T *U, T *R, T *ws)
+    {
+        auto s = [S](int i) { return Buffer<m * k>(S, i); };
+        auto t = [U](int i) { return Buffer<k * n>(U, i); };
+        auto r = [R](int i) { return Buffer<m * n>(R, i); };
+        const T *a22 = A + m * lda + k;
+        const T *b22 = B + k * ldb + n;
+        Next::Run(s(0), k, t(0), n, r(0), n, ws);
+        Next::Run(s(1), k, B, ldb, r(1), n, ws);
+        Next::Run(A, lda, t(1), n, r(2), n, ws);
+        Next::Run(a22, lda, t(2), n, r(3), n, ws);
+        Next::Run(s(2), k, b22, ldb, r(4), n, ws);
+        Next::Run(s(3), k, t(3), n, r(5), n, ws);
+        Next::Run(s(4), k, t(4), n, r(6), n, ws);
+    }
+
+    template<class T, i_type m, i_type n>
+    static void Backward(const T *R, T *C, i_type ldc)
+    {
+        const T *R1 = R, *R2 = Buffer<m * n>(R, 1), *R3 = Buffer<m * n>(R, 2),
+                *R4 = Buffer<m * n>(R, 3), *R5 = Buffer<m * n>(R, 4),
+                *R6 = Buffer<m * n>(R, 5), *R7 = Buffer<m * n>(R, 6);
+        for (i_type i = 0; i < m; ++i)
+        {
+            T *c11 = C + i * ldc, *c12 = c11 + n;
+            T *c21 = c11 + m * ldc, *c22 = c21 + n;
+            const i_type r = i * n;
+            for (i_type j = 0; j < n; ++j)
+            {
+                c11[j] = R1[r + j] + R4[r + j] - R5[r + j] + R7[r + j];
+                c12[j] = R3[r + j] + R5[r + j];
+                c21[j] = R2[r + j] + R4[r + j];
+                c22[j] = R1[r + j] - R2[r + j] + R3[r + j] + R6[r + j];
+            }
+        }
+    }
+};
+
+// Engine over a Step chain, owns the workspace of the whole chain
+template<class T, class Scheme, i_type M, i_type K, i_type N, i_type Cap>
+class Engine
+{
+    using Mat = Matrix<T>;
+    using Root = Step<T, Scheme, M, K, N, Cap>;
+
+    public:
+        Engine() : workspace_(WorkspaceSize()) {}
+
+        void Execute(const Mat &A, const Mat &B, Mat &C)
+        {
+            if (A.GetRows() != M || A.GetCols() != K || B.GetRows() != K ||
+                B.GetCols() != N || C.GetRows() != M || C.GetCols() != N)
+            {
+                throw std::invalid_argument("Matrix size not match " + std::to_string(M) + "x" +
+                                            std::to_string(K) + "x" + std::to_string(N));
+            }
+            Root::Run(A.Data(), K, B.Data(), N, C.Data(), N, workspace_.Data());
+        }
+
+        // One-shot product, the workspace lives for this call only
+        static void Mul(const Mat &A, const Mat &B, Mat &C)
+        {
+            Engine().Execute(A, B, C);
+        }
+
+        static constexpr std::size_t WorkspaceSize() { return Root::Size(); }
+
+        // 2x2x2 levels above the leaf
+        static constexpr unsigned Depth()
+        {
+            unsigned depth = 0;
+            for (i_type lo = std::min({M, K, N}); lo > Cap + 1; lo /= 2)
+                ++depth;
+            return depth;
+        }
+
+    private:
+        Workspace<T> workspace_;
+};
+
+} // namespace fixed
+
+// Winograd and Strassen for a shape known at compile time, such as the
+// production sizes 256, 512, 1024 and 2048. Depth and the shape of every
+// level are template arguments, so the chain has no virtual calls and
+// each level's forward and backward passes are single fused loops with
+// constant trip counts. Every dimension must halve evenly down to the
+// leaf; use Winograd and Strassen for any other shape.
+//
+//  FixedWinograd<double, 1024>::Mul(A, B, C);
+template<class T, unsigned M, unsigned K = M, unsigned N = K, unsigned Cap = 127>
+using FixedWinograd = fixed::Engine<T, fixed::WinogradScheme, M, K, N, Cap>;
+
+template<class T, unsigned M, unsigned K = M, unsigned N = K, unsigned Cap = 127>
+using FixedStrassen = fixed::Engine<T, fixed::StrassenScheme, M, K, N, Cap>;
+
+} // namespace maykitbo
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "../gemm/gemm.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#ifdef MAYKITBO_CBLAS
+    #include <cblas.h>
+#endif
+
+namespace maykitbo {
+
+// Classic product the recursive engines bottom out in.
+//
+//  Naive    the i-j-k dot-product loop
+//  Blocked  the packed SIMD Gemm
+//  Blas     cblas_sgemm/cblas_dgemm, for float and double in builds with
+//           MAYKITBO_CBLAS defined (link a cblas); Blocked otherwise
+enum class Leaf { Naive, Blocked, Blas };
+
+inline const char *LeafName(Leaf leaf) noexcept
+{
+    switch (leaf)
+    {
+        case Leaf::Naive: return "naive";
+        case Leaf::Blocked: return "blocked";
+        case Leaf::Blas: return "blas";
+    }
+    return "unknown";
+}
+
+namespace detail {
+
+inline bool BlasAvailable() noexcept
+{
+#ifdef MAYKITBO_CBLAS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Leaf picked at startup: Blocked, or MAYKITBO_LEAF=naive|blocked|blas
+inline Leaf StartupLeaf() noexcept
+{
+    const char *env = std::getenv("MAYKITBO_LEAF");
+    if (env == nullptr)
+        return Leaf::Blocked;
+    for (Leaf leaf : {Leaf::Naive, Leaf::Blocked, Leaf::Blas})
+    {
+        if (std::strcmp(env, LeafName(leaf)) == 0 && (leaf != Leaf::Blas || BlasAvailable()))
+            return leaf;
+    }
+    return Leaf::Blocked;
+}
+
+inline std::atomic<Leaf> &ActiveLeaf() noexcept
+{
+    static std::atomic<Leaf> active{StartupLeaf()};
+    return active;
+}
+
+} // namespace detail
+
+// Leaf the recursive engines currently call
+inline Leaf ActiveLeaf() noexcept
+{
+    return detail::ActiveLeaf().load(std::memory_order_relaxed);
+}
+
+// Switches every engine to leaf, Blas falls back to Blocked in builds
+// without a cblas. Returns the leaf actually selected.
+inline Leaf SetLeaf(Leaf leaf) noexcept
+{
+    if (leaf == Leaf::Blas && !detail::BlasAvailable())
+        leaf = Leaf::Blocked;
+    detail::ActiveLeaf().store(leaf, std::memory_order_relaxed);
+    return leaf;
+}
+
+// C (m x n) = A (m x k) * B (k x n), or C += A * B with accumulate,
+// through the active leaf; throws parallel::Cancelled first if the
+// product was stopped
+template<class T>
+struct LeafProduct
+{
+    using i_type = unsigned;
+
+    static void Mul(i_type m, i_type n, i_type k,
+                    const T *A, i_type lda, const T *B, i_type ldb,
+                    T *C, i_type ldc, bool accumulate = false)
+    {
+        parallel::CheckCancel();
+        switch (ActiveLeaf())
+        {
+            case Leaf::Naive:
+                Naive(m, n, k, A, lda, B, ldb, C, ldc, accumulate);
+                return;
+            case Leaf::Blas:
+                if (Blas(m, n, k, A, lda, B, ldb, C, ldc, accumulate))
+                    return;
+                break;
+            case Leaf::Blocked:
+                break;
+        }
+        Gemm<T>::Mul(m, n, k, A, lda, B, ldb, C, ldc, accumulate);
+    }
+
+    static void Naive(i_type m, i_type n, i_type k,
+                      const T *A, i_type lda, const T *B, i_type ldb,
+                      T *C, i_type ldc, bool accumulate)
+    {
+        for (i_type i = 0; i < m; ++i)
+        {
+            for (i_type j = 0; j < n; ++j)
+            {
+                T sum = accumulate ? C[i * ldc + j] : T();
+                for (i_type p = 0; p < k; ++p)
+                {
+                    sum += A[i * lda + p] * B[p * ldb + j];
+                }
+                C[i * ldc + j] = sum;
+            }
+        }
+    }
+
+    // False when there is no cblas routine for T
+    static bool Blas([[maybe_unused]] i_type m, [[maybe_unused]] i_type n,
+                     [[maybe_unused]] i_type k,
+                     [[maybe_unused]] const T *A, [[maybe_unused]] i_type lda,
+                     [[maybe_unused]] const T *B, [[maybe_unused]] i_type ldb,
+                     [[maybe_unused]] T *C, [[maybe_unused]] i_type ldc,
+                     [[maybe_unused]] bool accumulate)
+    {
+#ifdef MAYKITBO_CBLAS
+        if constexpr (std::is_same_v<T, float>)
+        {
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k,
+                        1.0f, A, lda, B, ldb, accumulate ? 1.0f : 0.0f, C, ldc);
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k,
+                        1.0, A, lda, B, ldb, accumulate ? 1.0 : 0.0, C, ldc);
+            return true;
+        }
+#endif
+        return false;
+    }
+};
+
+} // namespace maykitbo
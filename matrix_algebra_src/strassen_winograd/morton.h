@@ -0,0 +1,349 @@
+#pragma once
+
+#include "../../matrix.h"
+#include "common.h"
+#include "tuning.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace maykitbo {
+
+// Matrix in tiled Z-order (Morton) layout. The matrix is zero-padded to
+// (tile_rows << depth) x (tile_cols << depth) and cut into 4^depth
+// row-major tiles stored in Z order (11, 12, 21, 22 at every level), so
+// every quadrant at every level of a 2x2 recursion is one contiguous
+// block laid out the same way as the whole.
+//
+// Products of matrices of equal depth stay in this layout, pipelines of
+// several products convert once at each end.
+template<class T>
+class MortonMatrix
+{
+    public:
+        using i_type = unsigned;
+
+        MortonMatrix() = default;
+        MortonMatrix(i_type rows, i_type cols, unsigned depth);
+        MortonMatrix(const Matrix<T> &other, unsigned depth);
+
+        // Fills from a row-major matrix of the same size
+        void Assign(const Matrix<T> &other);
+        void ToMatrix(Matrix<T> &out) const;
+        Matrix<T> ToMatrix() const;
+
+        T &operator()(i_type row, i_type col) noexcept { return data_[Index(row, col)]; }
+        const T &operator()(i_type row, i_type col) const noexcept { return data_[Index(row, col)]; }
+
+        i_type GetRows() const noexcept { return rows_; }
+        i_type GetCols() const noexcept { return cols_; }
+        unsigned GetDepth() const noexcept { return depth_; }
+        i_type TileRows() const noexcept { return tile_rows_; }
+        i_type TileCols() const noexcept { return tile_cols_; }
+
+        // Padded storage, 4^depth tiles
+        T *Data() noexcept { return data_.data(); }
+        const T *Data() const noexcept { return data_.data(); }
+        std::size_t Size() const noexcept { return data_.size(); }
+
+        // Depth at which every tile of an m x k by k x n product has its
+        // smallest dimension within cap + 1, as for Winograd
+        static unsigned Levels(i_type m, i_type k, i_type n,
+                               i_type cap = Tuned<T>().winograd_cap);
+
+    private:
+        // Offset of tile (tile_row, tile_col): its Z-order number times
+        // the tile size
+        std::size_t TileOffset(i_type tile_row, i_type tile_col) const noexcept;
+        std::size_t Index(i_type row, i_type col) const noexcept;
+        // Side of the tiles of a size at depth; checks both first, as the
+        // initializers of the constructor rely on them
+        static i_type TileSide(i_type size, unsigned depth);
+        // Elements of the padded storage of the tiles
+        static std::size_t Storage(i_type tile_rows, i_type tile_cols, unsigned depth);
+
+        i_type rows_ = 0, cols_ = 0;
+        unsigned depth_ = 0;
+        i_type tile_rows_ = 0, tile_cols_ = 0;
+        std::vector<T> data_;
+};
+
+// Winograd working natively on MortonMatrix: quadrants are contiguous,
+// so the forward and backward phases are flat vectorized passes and no
+// level gathers strided rows. Every level runs the two-temporary
+// schedule of Winograd::LevelLowMemory.
+template<class T>
+class MortonWinograd
+{
+    using MM = MortonMatrix<T>;
+    using i_type = unsigned;
+
+    public:
+        // Plan for products whose operands are m x k and k x n at depth
+        MortonWinograd(i_type m, i_type k, i_type n, unsigned depth);
+        void Execute(const MM &A, const MM &B, MM &C);
+        static void Mul(const MM &A, const MM &B, MM &C);
+
+        // Plans reused by Mul, see PlanCache
+        using Cache = PlanCache<MortonWinograd<T>>;
+        static Cache &Plans();
+
+        std::size_t WorkspaceSize() const;
+
+    private:
+        void Run(const T *A, const T *B, T *C, unsigned level, T *ws) const;
+        // Elements of one quadrant of A, B and C at level
+        std::size_t QuadrantA(unsigned level) const;
+        std::size_t QuadrantB(unsigned level) const;
+        std::size_t QuadrantC(unsigned level) const;
+
+        i_type m_, k_, n_;
+        unsigned depth_;
+        i_type tm_, tk_, tn_;
+        Workspace<T> workspace_;
+};
+
+template<class T>
+MortonMatrix<T>::MortonMatrix(i_type rows, i_type cols, unsigned depth)
+    : rows_(rows)
+    , cols_(cols)
+    , depth_(depth)
+    , tile_rows_(TileSide(rows, depth))
+    , tile_cols_(TileSide(cols, depth))
+    , data_(Storage(tile_rows_, tile_cols_, depth))
+{}
+
+template<class T>
+typename MortonMatrix<T>::i_type MortonMatrix<T>::TileSide(i_type size, unsigned depth)
+{
+    if (size == 0)
+        throw std::invalid_argument("MortonMatrix: size must be positive");
+    if (depth >= 32)
+        throw std::invalid_argument("MortonMatrix: depth must be below 32");
+    return ((size - 1) >> depth) + 1;
+}
+
+template<class T>
+std::size_t MortonMatrix<T>::Storage(i_type tile_rows, i_type tile_cols, unsigned depth)
+{
+    const std::size_t rows = std::size_t(tile_rows) << depth, cols = std::size_t(tile_cols) << depth;
+    if (rows > std::vector<T>().max_size() / cols)
+        throw std::length_error("MortonMatrix: padded size too large");
+    return rows * cols;
+}
+
+template<class T>
+MortonMatrix<T>::MortonMatrix(const Matrix<T> &other, unsigned depth)
+    : MortonMatrix(other.GetRows(), other.GetCols(), depth)
+{
+    Assign(other);
+}
+
+template<class T>
+unsigned MortonMatrix<T>::Levels(i_type m, i_type k, i_type n, i_type cap)
+{
+    i_type lo = std::min({m, k, n});
+    unsigned depth = 0;
+    while (((lo - 1) >> depth) + 1 > cap + 1)
+        ++depth;
+    return depth;
+}
+
+template<class T>
+std::size_t MortonMatrix<T>::TileOffset(i_type tile_row, i_type tile_col) const noexcept
+{
+    std::size_t z = 0;
+    for (unsigned level = depth_; level-- > 0;)
+        z = z * 4 + ((tile_row >> level) & 1) * 2 + ((tile_col >> level) & 1);
+    return z * tile_rows_ * tile_cols_;
+}
+
+template<class T>
+std::size_t MortonMatrix<T>::Index(i_type row, i_type col) const noexcept
+{
+    return TileOffset(row / tile_rows_, col / tile_cols_) +
+           (row % tile_rows_) * tile_cols_ + col % tile_cols_;
+}
+
+template<class T>
+void MortonMatrix<T>::Assign(const Matrix<T> &other)
+{
+    if (other.GetRows() != rows_ || other.GetCols() != cols_)
+        throw std::invalid_argument("Matrix size not match");
+    const i_type tiles = 1u << depth_;
+    for (i_type tr = 0; tr < tiles; ++tr)
+    {
+        for (i_type tc = 0; tc < tiles; ++tc)
+        {
+            T *tile = data_.data() + TileOffset(tr, tc);
+            const i_type col = tc * tile_cols_;
+            const i_type width = col < cols_ ? std::min(tile_cols_, cols_ - col) : 0;
+            for (i_type r = 0; r < tile_rows_; ++r)
+            {
+                const i_type row = tr * tile_rows_ + r;
+                T *dst = tile + r * tile_cols_;
+                i_type copied = 0;
+                if (row < rows_)
+                {
+                    const T *src = other.Data() + std::size_t(row) * cols_ + col;
+                    std::copy(src, src + width, dst);
+                    copied = width;
+                }
+                std::fill(dst + copied, dst + tile_cols_, T());
+            }
+        }
+    }
+}
+
+template<class T>
+void MortonMatrix<T>::ToMatrix(Matrix<T> &out) const
+{
+    if (out.GetRows() != rows_ || out.GetCols() != cols_)
+        throw std::invalid_argument("Matrix size not match");
+    const i_type tiles = 1u << depth_;
+    for (i_type tr = 0; tr < tiles; ++tr)
+    {
+        for (i_type tc = 0; tc < tiles; ++tc)
+        {
+            const i_type col = tc * tile_cols_;
+            if (col >= cols_)
+                continue;
+            const i_type width = std::min(tile_cols_, cols_ - col);
+            const T *tile = data_.data() + TileOffset(tr, tc);
+            for (i_type r = 0; r < tile_rows_ && tr * tile_rows_ + r < rows_; ++r)
+            {
+                const T *src = tile + r * tile_cols_;
+                std::copy(src, src + width,
+                          out.Data() + std::size_t(tr * tile_rows_ + r) * cols_ + col);
+            }
+        }
+    }
+}
+
+template<class T>
+Matrix<T> MortonMatrix<T>::ToMatrix() const
+{
+    Matrix<T> out(rows_, cols_);
+    ToMatrix(out);
+    return out;
+}
+
+template<class T>
+MortonWinograd<T>::MortonWinograd(i_type m, i_type k, i_type n, unsigned depth)
+    : m_(m), k_(k), n_(n)
+    , depth_(depth)
+    , tm_(((m - 1) >> depth) + 1)
+    , tk_(((k - 1) >> depth) + 1)
+    , tn_(((n - 1) >> depth) + 1)
+{
+    if (m == 0 || k == 0 || n == 0)
+        throw std::invalid_argument("Matrix size must be greater than 0");
+    workspace_.Reserve(WorkspaceSize());
+}
+
+template<class T>
+std::size_t MortonWinograd<T>::QuadrantA(unsigned level) const
+{
+    return (std::size_t(tm_) * tk_) << (2 * (level - 1));
+}
+
+template<class T>
+std::size_t MortonWinograd<T>::QuadrantB(unsigned level) const
+{
+    return (std::size_t(tk_) * tn_) << (2 * (level - 1));
+}
+
+template<class T>
+std::size_t MortonWinograd<T>::QuadrantC(unsigned level) const
+{
+    return (std::size_t(tm_) * tn_) << (2 * (level - 1));
+}
+
+// X holds the S sums and then P1, Y the T sums
+template<class T>
+std::size_t MortonWinograd<T>::WorkspaceSize() const
+{
+    using W = Workspace<T>;
+    std::size_t size = 0;
+    for (unsigned level = depth_; level > 0; --level)
+        size += W::Round(std::max(QuadrantA(level), QuadrantC(level))) + W::Round(QuadrantB(level));
+    return size;
+}
+
+template<class T>
+void MortonWinograd<T>::Mul(const MM &A, const MM &B, MM &C)
+{
+    typename Cache::Key key{A.GetRows(), A.GetCols(), B.GetCols(), A.GetDepth(), 1, 0};
+    std::unique_ptr<MortonWinograd<T>> W = Plans().Take(key);
+    if (!W)
+        W = std::make_unique<MortonWinograd<T>>(key[0], key[1], key[2], key[3]);
+    W->Execute(A, B, C);
+    std::size_t bytes = W->WorkspaceSize() * sizeof(T);
+    Plans().Give(key, std::move(W), bytes);
+}
+
+template<class T>
+typename MortonWinograd<T>::Cache &MortonWinograd<T>::Plans()
+{
+    static Cache cache;
+    return cache;
+}
+
+template<class T>
+void MortonWinograd<T>::Execute(const MM &A, const MM &B, MM &C)
+{
+    auto fits = [this](const MM &X, i_type rows, i_type cols)
+    {
+        return X.GetRows() == rows && X.GetCols() == cols && X.GetDepth() == depth_;
+    };
+    if (!fits(A, m_, k_) || !fits(B, k_, n_) || !fits(C, m_, n_))
+        throw std::invalid_argument("Matrix size not match");
+    Run(A.Data(), B.Data(), C.Data(), depth_, workspace_.Data());
+}
+
+template<class T>
+void MortonWinograd<T>::Run(const T *A, const T *B, T *C, unsigned level, T *ws) const
+{
+    if (level == 0)
+    {
+        LeafProduct<T>::Mul(tm_, tn_, tk_, A, tk_, B, tn_, C, tn_);
+        return;
+    }
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    const std::size_t qa = QuadrantA(level), qb = QuadrantB(level), qc = QuadrantC(level);
+    T *X = ws;
+    T *Y = X + Workspace<T>::Round(std::max(qa, qc));
+    T *next = Y + Workspace<T>::Round(qb);
+    auto run = [&](const T *a, const T *b, T *c) { Run(a, b, c, level - 1, next); };
+
+    const T *a11 = A, *a12 = A + qa, *a21 = A + 2 * qa, *a22 = A + 3 * qa;
+    const T *b11 = B, *b12 = B + qb, *b21 = B + 2 * qb, *b22 = B + 3 * qb;
+    T *c11 = C, *c12 = C + qc, *c21 = C + 2 * qc, *c22 = C + 3 * qc;
+
+    K.sub(qa, a11, a21, X);         // S3
+    K.sub(qb, b22, b12, Y);         // T3
+    run(X, Y, c21);                 // P7
+    K.add(qa, a21, a22, X);         // S1
+    K.sub(qb, b12, b11, Y);         // T1
+    run(X, Y, c22);                 // P5
+    K.sub(qa, X, a11, X);           // S2
+    K.sub(qb, b22, Y, Y);           // T2
+    run(X, Y, c12);                 // P6
+    K.sub(qa, a12, X, X);           // S4
+    run(X, b22, c11);               // P3
+    run(a11, b11, X);               // P1
+    K.add(qc, X, c12, c12);         // U2 = P1 + P6
+    K.add(qc, c12, c21, c21);       // U3 = U2 + P7
+    K.add(qc, c12, c22, c12);       // U4 = U2 + P5
+    K.add(qc, c21, c22, c22);       // C22 = U3 + P5
+    K.add(qc, c12, c11, c12);       // C12 = U4 + P3
+    K.sub(qb, Y, b21, Y);           // T4
+    run(a22, Y, c11);               // P4
+    K.sub(qc, c21, c11, c21);       // C21 = U3 - P4
+    run(a12, b21, c11);             // P2
+    K.add(qc, X, c11, c11);         // C11 = P1 + P2
+}
+
+} // namespace maykitbo
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "bilinear.h"
+#include "tuning.h"
+
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace maykitbo {
+
+// Cost model of the planner, in units of one multiply-add of the leaf.
+// A leaf product costs m k n; a level costs the elements its additions
+// read and write times element, plus the cost of its rank children.
+struct BilinearCost
+{
+    double element;
+
+    // Element cost that puts the break-even of one Strassen level near
+    // the tuned Winograd cap of T under the active leaf: a level on an
+    // even 2b cube saves b^3 and moves about 74 b^2 elements
+    template<class T>
+    static BilinearCost For()
+    {
+        return {Tuned<T>().winograd_cap / 148.0};
+    }
+
+    double Leaf(unsigned m, unsigned k, unsigned n) const
+    {
+        return double(m) * k * n;
+    }
+
+    // Elements moved by the additions of one level of s on m x k x n
+    double Traffic(const BilinearScheme &s, unsigned m, unsigned k, unsigned n) const;
+};
+
+// Picks, for every level of an m x k x n product, the scheme and split
+// of the lowest model cost among a set of schemes, or the leaf when no
+// split pays off. Rectangular schemes let a level follow the shape of
+// its block instead of the square grid of Strassen or Winograd.
+class BilinearPlanner
+{
+    public:
+        // Strassen, Laderman, and Strassen joined with classic columns,
+        // rows or inner blocks: <2,2,3;11>, <3,2,2;11>, <2,3,2;11>
+        static std::vector<BilinearScheme> DefaultSchemes();
+
+        BilinearPlanner(std::vector<BilinearScheme> schemes, BilinearCost cost);
+
+        BilinearPlan Plan(unsigned m, unsigned k, unsigned n) const;
+
+    private:
+        using Shape = std::tuple<unsigned, unsigned, unsigned>;
+        // Cheapest (cost, scheme) of a shape, memoized over the shapes
+        // the recursion reaches
+        std::pair<double, int> Best(unsigned m, unsigned k, unsigned n,
+                                    std::map<Shape, std::pair<double, int>> &memo) const;
+
+        std::vector<BilinearScheme> schemes_;
+        BilinearCost cost_;
+};
+
+inline double BilinearCost::Traffic(const BilinearScheme &s, unsigned m, unsigned k,
+                                    unsigned n) const
+{
+    const double bm = (m + s.m - 1) / s.m, bk = (k + s.k - 1) / s.k, bn = (n + s.n - 1) / s.n;
+    const bool whole_a = m % s.m == 0 && k % s.k == 0, whole_b = k % s.k == 0 && n % s.n == 0;
+    // An operand sum is a fill and a read-modify-write per term, unless
+    // it is one whole block passed in place
+    auto sum = [](const int *coef, unsigned blocks, bool whole, double size)
+    {
+        unsigned terms = 0;
+        bool unit = true;
+        for (unsigned i = 0; i < blocks; ++i)
+        {
+            terms += coef[i] != 0;
+            unit = unit && (coef[i] == 0 || coef[i] == 1);
+        }
+        return terms == 1 && unit && whole ? 0.0 : (1 + 2 * terms) * size;
+    };
+    double elements = 0;
+    for (unsigned t = 0; t < s.rank; ++t)
+    {
+        elements += sum(&s.U[t * s.m * s.k], s.m * s.k, whole_a, bm * bk);
+        elements += sum(&s.V[t * s.k * s.n], s.k * s.n, whole_b, bk * bn);
+    }
+    for (int w : s.W)
+        elements += (w != 0) * 2 * bm * bn;
+    return elements * element;
+}
+
+inline std::vector<BilinearScheme> BilinearPlanner::DefaultSchemes()
+{
+    const BilinearScheme &s = schemes::Strassen();
+    return {s, schemes::Laderman(),
+            schemes::Join(s, schemes::Classic(2, 2, 1), 'n'),
+            schemes::Join(s, schemes::Classic(1, 2, 2), 'm'),
+            schemes::Join(s, schemes::Classic(2, 1, 2), 'k')};
+}
+
+inline BilinearPlanner::BilinearPlanner(std::vector<BilinearScheme> schemes, BilinearCost cost)
+    : schemes_(std::move(schemes))
+    , cost_(cost)
+{
+    for (const BilinearScheme &scheme : schemes_)
+    {
+        if (!scheme.Valid() || scheme.m * scheme.k * scheme.n < 2)
+            throw std::invalid_argument("BilinearScheme " + scheme.name + " cannot be planned");
+    }
+}
+
+inline std::pair<double, int> BilinearPlanner::Best(unsigned m, unsigned k, unsigned n,
+                                                    std::map<Shape, std::pair<double, int>> &memo) const
+{
+    auto found = memo.find({m, k, n});
+    if (found != memo.end())
+        return found->second;
+    std::pair<double, int> best{cost_.Leaf(m, k, n), -1};
+    for (std::size_t i = 0; i < schemes_.size(); ++i)
+    {
+        const BilinearScheme &s = schemes_[i];
+        if (m < s.m || k < s.k || n < s.n)
+            continue;
+        const unsigned bm = (m + s.m - 1) / s.m, bk = (k + s.k - 1) / s.k, bn = (n + s.n - 1) / s.n;
+        double cost = cost_.Traffic(s, m, k, n);
+        // Additions alone already cost more than the best so far
+        if (cost >= best.first)
+            continue;
+        cost += s.rank * Best(bm, bk, bn, memo).first;
+        if (cost < best.first)
+            best = {cost, static_cast<int>(i)};
+    }
+    memo[{m, k, n}] = best;
+    return best;
+}
+
+inline BilinearPlan BilinearPlanner::Plan(unsigned m, unsigned k, unsigned n) const
+{
+    if (m == 0 || k == 0 || n == 0)
+        throw std::invalid_argument("Matrix size must be greater than 0");
+    std::map<Shape, std::pair<double, int>> memo;
+    BilinearPlan plan{schemes_, {}};
+    for (;;)
+    {
+        auto [cost, scheme] = Best(m, k, n, memo);
+        plan.nodes.push_back({m, k, n, scheme, cost});
+        if (scheme < 0)
+            break;
+        const BilinearScheme &s = schemes_[scheme];
+        m = (m + s.m - 1) / s.m;
+        k = (k + s.k - 1) / s.k;
+        n = (n + s.n - 1) / s.n;
+    }
+    return plan;
+}
+
+} // namespace maykitbo
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "../../matrix.h"
+#include "strassen.h"
+#include "tuning.h"
+#include "winograd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace maykitbo {
+
+// Accuracy a floating-point fast product has to meet, as the normwise
+// relative error |C' - A B|max / (|A|max |B|max).
+struct Accuracy
+{
+    enum class Bound
+    {
+        Typical,   // an estimate, not a guarantee: the square root of the
+                   // worst-case growth, as for rounding errors of random
+                   // sign, times stability::typical_margin
+        Worst      // Higham's worst-case bound, guaranteed
+    };
+
+    double tolerance;
+    // Balance the columns of A against the rows of B by powers of two
+    // before recursing, when it shrinks |A|max |B|max
+    bool scale = false;
+    Bound bound = Bound::Typical;
+};
+
+// Plan picked for an accuracy target
+struct StabilityReport
+{
+    unsigned depth;           // fast levels run
+    unsigned natural_depth;   // fast levels of the unconstrained plan
+    double estimate;          // estimated relative error at depth
+    bool scaled;
+    bool met;                 // estimate within the tolerance: the error is
+                              // only sure to be within it for Bound::Worst
+};
+
+namespace stability {
+
+// Factor on the Typical estimate: random operands come out at up to about
+// half of it, adversarial ones can still exceed it
+constexpr double typical_margin = 2;
+
+// Worst-case growth f of |C' - A B|max <= f u |A|max |B|max for depth
+// levels over an inner dimension k (Higham, Accuracy and Stability of
+// Numerical Algorithms, 23.2): with k0 = k / 2^depth,
+//
+//  g^depth (k0^2 + a k0) - a k,  g = 12, a = 5 for Strassen
+//                                g = 18, a = 6 for Winograd
+//
+// and k^2 for the classic product, depth 0.
+inline double Growth(double g, double a, unsigned k, unsigned depth)
+{
+    const double k0 = std::ceil(std::ldexp(double(k), -int(depth)));
+    const double inner = k0 * std::ldexp(1.0, int(depth));
+    return std::max(std::pow(g, depth) * (k0 * k0 + a * k0) - a * inner, k0 * k0);
+}
+
+template<class T>
+double MaxNorm(const Matrix<T> &A)
+{
+    double norm = 0;
+    const T *data = A.Data();
+    for (std::size_t i = 0, size = std::size_t(A.GetRows()) * A.GetCols(); i < size; ++i)
+        norm = std::max(norm, double(std::abs(data[i])));
+    return norm;
+}
+
+// Inside scaling D with A D^-1 and D B: d_p is the power of two nearest
+// to sqrt(|column p of A|max / |row p of B|max), so both come out alike
+template<class T>
+std::vector<T> InsideScaling(const Matrix<T> &A, const Matrix<T> &B)
+{
+    const unsigned m = A.GetRows(), k = A.GetCols(), n = B.GetCols();
+    std::vector<T> column(k, T()), row(k, T()), d(k, T(1));
+    for (unsigned i = 0; i < m; ++i)
+        for (unsigned p = 0; p < k; ++p)
+            column[p] = std::max(column[p], std::abs(A(i, p)));
+    for (unsigned p = 0; p < k; ++p)
+    {
+        for (unsigned j = 0; j < n; ++j)
+            row[p] = std::max(row[p], std::abs(B(p, j)));
+        if (column[p] > T() && row[p] > T())
+            d[p] = std::ldexp(T(1), int(std::lround(0.5 * std::log2(double(column[p] / row[p])))));
+    }
+    return d;
+}
+
+template<template<class> class Engine>
+struct Traits;
+
+template<>
+struct Traits<Winograd>
+{
+    static constexpr double g = 18, a = 6;
+
+    static unsigned Depth(unsigned lo, unsigned cap)
+    {
+        unsigned depth = 0;
+        while (((lo - 1) >> depth) + 1 > cap + 1)
+            ++depth;
+        return depth;
+    }
+
+    // Cap that stops the recursion after depth levels
+    template<class T>
+    static void Mul(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C, unsigned depth,
+                    unsigned cap)
+    {
+        const unsigned lo = std::min({A.GetRows(), A.GetCols(), B.GetCols()});
+        Winograd<T>::Mul(A, B, C, std::max(cap, ((lo - 1) >> depth)));
+    }
+};
+
+template<>
+struct Traits<Strassen>
+{
+    static constexpr double g = 12, a = 5;
+
+    static unsigned Depth(unsigned lo, unsigned cap)
+    {
+        unsigned depth = 0;
+        for (; lo / 2 > 1 && lo >= cap; lo = (lo + 1) / 2)
+            ++depth;
+        return depth;
+    }
+
+    // Strassen turns classic below strassen_cap: cap just above the
+    // even size at depth
+    template<class T>
+    static void Mul(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C, unsigned depth,
+                    unsigned cap)
+    {
+        const unsigned lo = std::min({A.GetRows(), A.GetCols(), B.GetCols()});
+        const unsigned low = ((lo - 1) >> depth) + 1;
+        Strassen<T>::Mul(A, B, C, Tuned<T>().odd_cap, std::max(cap, (low + 1) / 2 * 2 + 1));
+    }
+};
+
+} // namespace stability
+
+// Fast product of floating-point matrices that meets an Accuracy: the
+// error estimate of Engine (Winograd or Strassen) grows with every level,
+// so the plan runs the deepest recursion, no deeper than the cap allows,
+// whose estimate stays within the tolerance. Optional inside scaling
+// takes the scale of the operands out of the estimate.
+template<class T, template<class> class Engine>
+class Stable
+{
+    static_assert(std::is_floating_point_v<T>, "Stable is for floating-point matrices");
+
+    using M = Matrix<T>;
+    using Traits = stability::Traits<Engine>;
+
+    public:
+        // Depth, scaling and estimate for A * B, cap as for Engine
+        // (strassen_cap for Strassen)
+        static StabilityReport Plan(const M &A, const M &B, const Accuracy &accuracy,
+                                    unsigned cap = DefaultCap());
+        static StabilityReport Mul(const M &A, const M &B, M &C, const Accuracy &accuracy,
+                                   unsigned cap = DefaultCap());
+
+        static unsigned DefaultCap()
+        {
+            return std::is_same_v<Engine<T>, Winograd<T>> ? Tuned<T>().winograd_cap
+                                                          : Tuned<T>().strassen_cap;
+        }
+
+    private:
+        static StabilityReport Plan(const M &A, const M &B, const Accuracy &accuracy,
+                                    unsigned cap, std::vector<T> &scaling);
+};
+
+template<class T>
+using StableWinograd = Stable<T, Winograd>;
+template<class T>
+using StableStrassen = Stable<T, Strassen>;
+
+template<class T, template<class> class Engine>
+StabilityReport Stable<T, Engine>::Plan(const M &A, const M &B, const Accuracy &accuracy,
+                                        unsigned cap)
+{
+    std::vector<T> scaling;
+    return Plan(A, B, accuracy, cap, scaling);
+}
+
+template<class T, template<class> class Engine>
+StabilityReport Stable<T, Engine>::Plan(const M &A, const M &B, const Accuracy &accuracy,
+                                        unsigned cap, std::vector<T> &scaling)
+{
+    if (A.GetCols() != B.GetRows())
+        throw std::invalid_argument("Matrix size not match");
+    const unsigned k = A.GetCols();
+    const unsigned lo = std::min({A.GetRows(), k, B.GetCols()});
+
+    // |A D^-1|max |D B|max relative to |A|max |B|max
+    double ratio = 1;
+    const double norms = stability::MaxNorm(A) * stability::MaxNorm(B);
+    if (accuracy.scale && norms > 0)
+    {
+        scaling = stability::InsideScaling(A, B);
+        double a = 0, b = 0;
+        for (unsigned i = 0; i < A.GetRows(); ++i)
+            for (unsigned p = 0; p < k; ++p)
+                a = std::max(a, double(std::abs(A(i, p) / scaling[p])));
+        for (unsigned p = 0; p < k; ++p)
+            for (unsigned j = 0; j < B.GetCols(); ++j)
+                b = std::max(b, double(std::abs(B(p, j) * scaling[p])));
+        ratio = a * b / norms;
+        if (ratio >= 1)
+        {
+            scaling.clear();
+            ratio = 1;
+        }
+    }
+
+    const double u = std::numeric_limits<T>::epsilon() / 2;
+    auto estimate = [&](unsigned depth)
+    {
+        double f = stability::Growth(Traits::g, Traits::a, k, depth);
+        if (accuracy.bound == Accuracy::Bound::Typical)
+            f = stability::typical_margin * std::sqrt(f);
+        return f * u * ratio;
+    };
+
+    StabilityReport report{0, Traits::Depth(lo, cap), 0, !scaling.empty(), false};
+    report.depth = report.natural_depth;
+    while (report.depth > 0 && estimate(report.depth) > accuracy.tolerance)
+        --report.depth;
+    report.estimate = estimate(report.depth);
+    report.met = report.estimate <= accuracy.tolerance;
+    return report;
+}
+
+template<class T, template<class> class Engine>
+StabilityReport Stable<T, Engine>::Mul(const M &A, const M &B, M &C, const Accuracy &accuracy,
+                                       unsigned cap)
+{
+    if (C.GetRows() != A.GetRows() || C.GetCols() != B.GetCols())
+        throw std::invalid_argument("Matrix size not match");
+    std::vector<T> scaling;
+    StabilityReport report = Plan(A, B, accuracy, cap, scaling);
+    if (!report.scaled)
+    {
+        Traits::Mul(A, B, C, report.depth, cap);
+        return report;
+    }
+
+    // Powers of two: A D^-1 and D B are exact
+    M SA(A), SB(B);
+    for (unsigned i = 0; i < SA.GetRows(); ++i)
+        for (unsigned p = 0; p < SA.GetCols(); ++p)
+            SA(i, p) /= scaling[p];
+    for (unsigned p = 0; p < SB.GetRows(); ++p)
+        for (unsigned j = 0; j < SB.GetCols(); ++j)
+            SB(p, j) *= scaling[p];
+    Traits::Mul(SA, SB, C, report.depth, cap);
+    return report;
+}
+
+} // namespace maykitbo
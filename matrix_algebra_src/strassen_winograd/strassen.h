@@ -1,13 +1,16 @@
 #pragma once
 
 #include "../../matrix.h"
+#include "common.h"
+#include "tuning.h"
 
 #include <vector>
 #include <thread>
 #include <memory>
+#include <map>
+#include <tuple>
 
 #ifdef LEVEL_LOAD_TEST__P
-    #include <map>
     #include <chrono>
     #define TIME std::chrono::high_resolution_clock::now
     #define DURATION(x) std::chrono::duration_cast<std::chrono::nanoseconds>(TIME() - x).count()
@@ -25,10 +28,28 @@ class Strassen
     using data_t = typename M::base;
 
     public:
-        Strassen(i_type n, i_type odd_cap = 25, i_type strassen_cap = 17);
+        Strassen(i_type n, i_type odd_cap = Tuned<T>().odd_cap,
+                 i_type strassen_cap = Tuned<T>().strassen_cap);
+        Strassen(i_type m, i_type k, i_type n, i_type odd_cap,
+                 i_type strassen_cap = Tuned<T>().strassen_cap);
+        // Plan working in a caller-supplied buffer of WorkspaceSize()
+        // elements aligned to Workspace<T>::alignment
+        Strassen(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap, T *workspace);
         void Execute(const M &A, const M &B, M &C);
         static void Mul(const M &A, const M &B, M &C,
-                        i_type odd_cap = 25, i_type strassen_cap = 17);
+                        i_type odd_cap = Tuned<T>().odd_cap,
+                        i_type strassen_cap = Tuned<T>().strassen_cap);
+
+        // Plans reused by Mul, see PlanCache
+        using Cache = PlanCache<Strassen<T>>;
+        static Cache &Plans();
+
+        std::size_t WorkspaceSize() const;
+        static std::size_t WorkspaceSize(i_type n, i_type odd_cap = Tuned<T>().odd_cap,
+                                         i_type strassen_cap = Tuned<T>().strassen_cap);
+        static std::size_t WorkspaceSize(i_type m, i_type k, i_type n,
+                                         i_type odd_cap,
+                                         i_type strassen_cap = Tuned<T>().strassen_cap);
         
         virtual ~Strassen() = default;
 
@@ -37,39 +58,101 @@ class Strassen
 #else
     protected:
 #endif
-        Strassen() = default;
-        void InitAnalysis(i_type n, i_type odd_cap, i_type strassen_cap);
-
         struct Level;
         struct LevelEven;
         struct LevelOdd;
+        struct LevelSplit;
+        struct LevelPeel;
         struct LevelClassic;
         struct Level22;
         struct PointerBase;
-        
+        using Memo = std::map<std::tuple<i_type, i_type, i_type>, Level *>;
+
+        Strassen() = default;
+        void Plan(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap);
+        void Bind(T *workspace);
+        void InitAnalysis(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap);
+        Level *Build(i_type m, i_type k, i_type n,
+                     i_type odd_cap, i_type strassen_cap, Memo &memo);
+        static void CheckSize(const M &A, const M &B, const M &C);
+
+        template<class L, class... Args>
+        L *Emplace(Args... args);
+
         std::vector<std::unique_ptr<Level>> L_;
-        i_type n_;
+        i_type m_, k_, n_;
+        Workspace<T> workspace_;
 };
 
 template<class T>
-void Strassen<T>::Mul(const M &A, const M &B, M &C,
-            i_type odd_cap, i_type strassen_cap)
+void Strassen<T>::CheckSize(const M &A, const M &B, const M &C)
 {
-
-    i_type n = A.GetCols();
-    if (n <= 1 || B.GetCols() != n || C.GetCols() != n ||
-        A.GetRows() != n || B.GetRows() != n || C.GetRows() != n)
+    if (A.GetCols() != B.GetRows() || C.GetRows() != A.GetRows() || C.GetCols() != B.GetCols())
     {
         throw std::invalid_argument("Matrix size not match");
     }
-    Strassen<T> W(n, odd_cap, strassen_cap);
-    W.Execute(A, B, C);
+}
+
+template<class T>
+void Strassen<T>::Mul(const M &A, const M &B, M &C,
+            i_type odd_cap, i_type strassen_cap)
+{
+    CheckSize(A, B, C);
+    typename Cache::Key key{A.GetRows(), A.GetCols(), B.GetCols(), odd_cap, strassen_cap, 1};
+    std::unique_ptr<Strassen<T>> W = Plans().Take(key);
+    if (!W)
+        W = std::make_unique<Strassen<T>>(key[0], key[1], key[2], odd_cap, strassen_cap);
+    W->Execute(A, B, C);
+    std::size_t bytes = W->WorkspaceSize() * sizeof(T);
+    Plans().Give(key, std::move(W), bytes);
+}
+
+template<class T>
+typename Strassen<T>::Cache &Strassen<T>::Plans()
+{
+    static Cache cache;
+    return cache;
+}
+
+template<class T>
+std::size_t Strassen<T>::WorkspaceSize() const
+{
+    std::size_t size = 0;
+    for (auto &level : L_)
+        size += level->Size();
+    return size;
+}
+
+template<class T>
+std::size_t Strassen<T>::WorkspaceSize(i_type n, i_type odd_cap, i_type strassen_cap)
+{
+    return WorkspaceSize(n, n, n, odd_cap, strassen_cap);
+}
+
+template<class T>
+std::size_t Strassen<T>::WorkspaceSize(i_type m, i_type k, i_type n,
+                                       i_type odd_cap, i_type strassen_cap)
+{
+    Strassen<T> W;
+    W.Plan(m, k, n, odd_cap, strassen_cap);
+    return W.WorkspaceSize();
+}
+
+template<class T>
+void Strassen<T>::Bind(T *workspace)
+{
+    for (auto &level : L_)
+        workspace = level->Bind(workspace);
 }
 
 template<class T>
 struct Strassen<T>::Level
 {
-    virtual void SW(const T *A, const T *B, T *C) = 0;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) = 0;
+    // Workspace elements the level needs and binding of its buffers to
+    // the front of ws, returns the rest of ws
+    virtual std::size_t Size() const { return 0; }
+    virtual T *Bind(T *ws) { return ws; }
     Level *next;
     virtual ~Level() = default;
 };
@@ -80,10 +163,25 @@ struct Strassen<T>::PointerBase
     T *A11, *A12, *A22, *B11, *B21, *B22;
     T *S1, *S2, *S3, *S4, *T1, *T2, *T3, *T4;
     T *R1, *R2, *R3, *R4, *R5, *R6, *R7;
-    i_type n;
-
-    PointerBase(i_type n);
-    virtual ~PointerBase();
+    i_type m, k, n;
+    i_type rm, rk, rn;
+    // The parent is exactly twice the quadrants: plain quadrants are read
+    // in place as windows of it and get no buffers
+    bool window;
+
+    PointerBase(i_type m, i_type k, i_type n, i_type rm, i_type rk, i_type rn);
+    virtual ~PointerBase() = default;
+
+    std::size_t Size() const;
+    T *Bind(T *ws);
+
+    // Quadrant rows [from, to) of the forward and backward phases, one
+    // vectorized pass per quadrant row. Quadrants are m x k, k x n and
+    // m x n; the parent is rm x rk times rk x rn, odd parents are padded
+    // with zeros.
+    void ForwardA(const T *A, i_type lda, i_type from, i_type to);
+    void ForwardB(const T *B, i_type ldb, i_type from, i_type to);
+    void Backward(T *C, i_type ldc, i_type from, i_type to);
 };
 
 template<class T>
@@ -91,16 +189,18 @@ struct Strassen<T>::LevelEven : public Level, public PointerBase
 {
     using Level::next;
     using PB = PointerBase;
-    using PB::n;
+    using PB::m, PB::k, PB::n;
     using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
         PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
         PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
 
-    LevelEven(i_type n)
-        : PointerBase(n)
+    LevelEven(i_type m, i_type k, i_type n)
+        : PointerBase(m, k, n, m * 2, k * 2, n * 2)
     {}
     virtual ~LevelEven() = default;
-    virtual void SW(const T *A, const T *B, T *C) override;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override { return PB::Size(); }
+    T *Bind(T *ws) override { return PB::Bind(ws); }
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static std::map<i_type, std::pair<int64_t, int64_t>> level_load;
@@ -112,26 +212,42 @@ struct Strassen<T>::LevelOdd : public Level, public PointerBase
 {
     using Level::next;
     using PB = PointerBase;
-    using PB::n;
+    using PB::m, PB::k, PB::n;
     using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
         PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
         PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
 
-    LevelOdd(i_type n) : PointerBase(n) {}
+    LevelOdd(i_type m, i_type k, i_type n, i_type real_m, i_type real_k, i_type real_n)
+        : PointerBase(m, k, n, real_m, real_k, real_n)
+    {}
     virtual ~LevelOdd() = default;
-    virtual void SW(const T *A, const T *B, T *C) override;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override { return PB::Size(); }
+    T *Bind(T *ws) override { return PB::Bind(ws); }
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static std::map<i_type, std::pair<int64_t, int64_t>> level_load;
 #endif
 };
 
+template<class T>
+struct Strassen<T>::LevelSplit final : public SplitLevel<T, Level>
+{
+    using SplitLevel<T, Level>::SplitLevel;
+};
+
+template<class T>
+struct Strassen<T>::LevelPeel final : public PeelLevel<T, Level>
+{
+    using PeelLevel<T, Level>::PeelLevel;
+};
+
 template<class T>
 struct Strassen<T>::LevelClassic final : public Level
 {
-    i_type n;
-    LevelClassic(i_type n) : n(n) {}
-    void SW(const T *A, const T *B, T *C) override;
+    i_type m, k, n;
+    LevelClassic(i_type m, i_type k, i_type n) : m(m), k(k), n(n) {}
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static int64_t load{0};
@@ -142,7 +258,7 @@ template<class T>
 struct Strassen<T>::Level22 final : public Level
 {
     using Level::next;
-    void SW(const T *A, const T *B, T *C) override;   
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;   
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static int64_t load{0};
@@ -150,49 +266,117 @@ struct Strassen<T>::Level22 final : public Level
 };
 
 template<class T>
-void Strassen<T>::InitAnalysis(i_type n, i_type odd_cap, i_type strassen_cap)
+template<class L, class... Args>
+L *Strassen<T>::Emplace(Args... args)
 {
-    bool odd = (n % 2 != 0);
-    n += odd;
-    bool cap = false;
+    L_.push_back(std::make_unique<L>(args...));
+    return static_cast<L *>(L_.back().get());
+}
 
-    while ((n /= 2) != 1) {
-        if ((odd && n < odd_cap) || n * 2 < strassen_cap) {
-            L_.push_back(std::make_unique<LevelClassic>(n * 2 - odd));
-            cap = true;
-            break;
+template<class T>
+typename Strassen<T>::Level *Strassen<T>::Build(i_type m, i_type k, i_type n,
+                                                i_type odd_cap, i_type strassen_cap, Memo &memo)
+{
+    auto found = memo.find({m, k, n});
+    if (found != memo.end())
+        return found->second;
+
+    Level *level;
+    typename LevelSplit::Dim dim;
+    bool odd = (m % 2 != 0 || k % 2 != 0 || n % 2 != 0);
+    i_type half = (std::min({m, k, n}) + 1) / 2;
+    if (m == 2 && k == 2 && n == 2)
+    {
+        level = Emplace<Level22>();
+    }
+    else if (half == 1 || (odd && half < odd_cap) || half * 2 < strassen_cap)
+    {
+        level = Emplace<LevelClassic>(m, k, n);
+    }
+    else if (LevelSplit::Unbalanced(m, k, n, dim))
+    {
+        LevelSplit *split = Emplace<LevelSplit>(dim, m, k, n);
+        i_type first[3], second[3];
+        LevelSplit::Halves(dim, m, k, n, first, second);
+        split->next = Build(first[0], first[1], first[2], odd_cap, strassen_cap, memo);
+        split->next2 = Build(second[0], second[1], second[2], odd_cap, strassen_cap, memo);
+        level = split;
+    }
+    else
+    {
+        // An odd shape either pads by one on every odd level below, or is
+        // peeled once to a core that stays even down to the classic leaves
+        i_type hm = (m + 1) / 2, hk = (k + 1) / 2, hn = (n + 1) / 2, core[3];
+        i_type step = 1;
+        unsigned depth = 0;
+        for (i_type lo = std::min({m, k, n}); lo / 2 > 1 && lo >= strassen_cap; lo /= 2)
+        {
+            step *= 2;
+            ++depth;
+        }
+        if (!odd)
+        {
+            level = Emplace<LevelEven>(hm, hk, hn);
+            level->next = Build(hm, hk, hn, odd_cap, strassen_cap, memo);
+        }
+        else if (LevelPeel::Cheaper(m, k, n, step, depth, core))
+        {
+            level = Emplace<LevelPeel>(m, k, n, core[0], core[1], core[2]);
+            level->next = Build(core[0], core[1], core[2], odd_cap, strassen_cap, memo);
         }
-        if (odd)
-            L_.push_back(std::make_unique<LevelOdd>(n));
         else
-            L_.push_back(std::make_unique<LevelEven>(n));
-
-        odd = (n % 2 != 0);
-        n += odd;
-    }
-
-    if (!cap) {
-        L_.push_back(std::make_unique<Level22>());
+        {
+            level = Emplace<LevelOdd>(hm, hk, hn, m, k, n);
+            level->next = Build(hm, hk, hn, odd_cap, strassen_cap, memo);
+        }
     }
+    memo[{m, k, n}] = level;
+    return level;
+}
 
-    for (int i = L_.size() - 1; i > 0; --i) {
-        L_[i - 1]->next = &(*L_[i]);
-    }
+template<class T>
+void Strassen<T>::InitAnalysis(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap)
+{
+    Memo memo;
+    Build(m, k, n, odd_cap, strassen_cap, memo);
 }
 
 template<class T>
 Strassen<T>::Strassen(i_type n, i_type odd_cap, i_type strassen_cap)
-    : n_(n)
+    : Strassen(n, n, n, odd_cap, strassen_cap)
+{}
+
+template<class T>
+Strassen<T>::Strassen(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap)
+{
+    Plan(m, k, n, odd_cap, strassen_cap);
+    Bind(workspace_.Reserve(WorkspaceSize()));
+}
+
+template<class T>
+Strassen<T>::Strassen(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap,
+                      T *workspace)
+{
+    Workspace<T>::CheckAligned(workspace);
+    Plan(m, k, n, odd_cap, strassen_cap);
+    Bind(workspace);
+}
+
+template<class T>
+void Strassen<T>::Plan(i_type m, i_type k, i_type n, i_type odd_cap, i_type strassen_cap)
 {
-    if (n <= 1) {
+    if (m <= 1 || k <= 1 || n <= 1) {
         throw std::invalid_argument("Matrix size must be greater than 1");
     }
+    m_ = m;
+    k_ = k;
+    n_ = n;
 
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    InitAnalysis(n, odd_cap, strassen_cap);
+    InitAnalysis(m, k, n, odd_cap, strassen_cap);
     
 #ifdef LEVEL_LOAD_TEST__P
     load += DURATION(time_p);
@@ -204,16 +388,17 @@ Strassen<T>::Strassen(i_type n, i_type odd_cap, i_type strassen_cap)
 template<class T>
 void Strassen<T>::Execute(const M &A, const M &B, M &C)
 {
-    if (A.GetCols() != n_ || B.GetCols() != n_ || C.GetCols() != n_ ||
-        A.GetRows() != n_ || B.GetRows() != n_ || C.GetRows() != n_)
+    if (A.GetRows() != m_ || A.GetCols() != k_ || B.GetRows() != k_ ||
+        B.GetCols() != n_ || C.GetRows() != m_ || C.GetCols() != n_)
     {
         throw std::invalid_argument("Matrix size not match ");
     }
-    L_[0]->SW(A.Data(), B.Data(), C.Data());
+    parallel::CheckCancel();
+    L_[0]->SW(A.Data(), k_, B.Data(), n_, C.Data(), n_);
 }
 
 template<class T>
-void Strassen<T>::Level22::SW(const T *A, const T *B, T *C)
+void Strassen<T>::Level22::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
@@ -221,16 +406,16 @@ void Strassen<T>::Level22::SW(const T *A, const T *B, T *C)
 
     T a11 = A[0];
     T a12 = A[1];
-    T a21 = A[2];
-    T a22 = A[3];
+    T a21 = A[lda];
+    T a22 = A[lda + 1];
     T b11 = B[0];
     T b12 = B[1];
-    T b21 = B[2];
-    T b22 = B[3];
+    T b21 = B[ldb];
+    T b22 = B[ldb + 1];
     C[0] = a11 * b11 + a12 * b21;
     C[1] = a11 * b12 + a12 * b22;
-    C[2] = a21 * b11 + a22 * b21;
-    C[3] = a21 * b12 + a22 * b22;
+    C[ldc] = a21 * b11 + a22 * b21;
+    C[ldc + 1] = a21 * b12 + a22 * b22;
 
 #ifdef LEVEL_LOAD_TEST__P
     load += DURATION(time_p);
@@ -238,24 +423,13 @@ void Strassen<T>::Level22::SW(const T *A, const T *B, T *C)
 }
 
 template<class T>
-void Strassen<T>::LevelClassic::SW(const T *A, const T *B, T *C)
+void Strassen<T>::LevelClassic::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    for (i_type i = 0; i < n; ++i)
-    {
-        for (i_type j = 0; j < n; ++j)
-        {
-            T sum = 0;
-            for (i_type k = 0; k < n; ++k)
-            {
-                sum += A[i * n + k] * B[k * n + j];
-            }
-            C[i * n + j] = sum;
-        }
-    }
+    LeafProduct<T>::Mul(m, n, k, A, lda, B, ldb, C, ldc);
 
 #ifdef LEVEL_LOAD_TEST__P
     load += DURATION(time_p);
@@ -263,88 +437,34 @@ void Strassen<T>::LevelClassic::SW(const T *A, const T *B, T *C)
 };
 
 template<class T>
-void Strassen<T>::LevelEven::SW(const T *A, const T *B, T *C)
+void Strassen<T>::LevelEven::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        i_type iadj = i * n;
-        i_type iadj2 = i * n * 2;
-        i_type inadj2 = in * n * 2;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T a11 = A[iadj2 + j];
-            T a12 = A[iadj2 + jn];
-            T a21 = A[inadj2 + j];
-            T a22 = A[inadj2 + jn];
-            i_type jadj = iadj + j;
-            A11[jadj] = a11;
-            A12[jadj] = a11 + a22;
-            A22[jadj] = a22;
-            S1[jadj] = a21 + a22;
-            S2[jadj] = a11 + a12;
-            S3[jadj] = a21 - a11;
-            S4[jadj] = a12 - a22;
-        }
-    }
-
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        i_type iadj = i * n;
-        i_type iadj2 = i * n * 2;
-        i_type inadj2 = in * n * 2;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T b11 = B[iadj2 + j];
-            T b12 = B[iadj2 + jn];
-            T b21 = B[inadj2 + j];
-            T b22 = B[inadj2 + jn];
-            i_type jadj = iadj + j;
-            B11[jadj] = b11;
-            B21[jadj] = b11 + b22;
-            B22[jadj] = b22;
-            T1[jadj] = b12 - b22;
-            T2[jadj] = b21 - b11;
-            T3[jadj] = b11 + b12;
-            T4[jadj] = b21 + b22;
-        }
-    }
-    
+    PB::ForwardA(A, lda, 0, m);
+    PB::ForwardB(B, ldb, 0, k);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].first += DURATION(time_p);
 #endif
 
-    next->SW(A12, B21, R1);
-    next->SW(S1, B11, R2);
-    next->SW(A11, T1, R3);
-    next->SW(A22, T2, R4);
-    next->SW(S2, B22, R5);
-    next->SW(S3, T3, R6);
-    next->SW(S4, T4, R7);
+    const T *a22 = A + m * lda + k;
+    const T *b22 = B + k * ldb + n;
+    next->SW(A12, k, B21, n, R1, n);
+    next->SW(S1, k, B, ldb, R2, n);
+    next->SW(A, lda, T1, n, R3, n);
+    next->SW(a22, lda, T2, n, R4, n);
+    next->SW(S2, k, b22, ldb, R5, n);
+    next->SW(S3, k, T3, n, R6, n);
+    next->SW(S4, k, T4, n, R7, n);
 
 #ifdef LEVEL_LOAD_TEST__P
     time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T r1 = R1[i * n + j];
-            T r2 = R2[i * n + j];
-            T r3 = R3[i * n + j];
-            T r4 = R4[i * n + j];
-            T r5 = R5[i * n + j];
-            C[i * n * 2 + j] = r1 + r4 -r5 + R7[i * n + j];
-            C[i * n * 2 + jn] = r3 + r5;
-            C[in * n * 2 + j] = r2 + r4;
-            C[in * n * 2 + jn] = r1 + r3 - r2 + R6[i * n + j];
-        }
-    }
+    PB::Backward(C, ldc, 0, m);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].second += DURATION(time_p);
@@ -352,90 +472,32 @@ void Strassen<T>::LevelEven::SW(const T *A, const T *B, T *C)
 }
 
 template<class T>
-void Strassen<T>::LevelOdd::SW(const T *A, const T *B, T *C)
+void Strassen<T>::LevelOdd::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    i_type limit = n * 2 - 1;
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        i_type iadj = i * n;
-        i_type iadj2 = i * limit;
-        i_type inadj2 = in * limit;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T a11 = A[iadj2 + j];
-            T a12 = (jn == limit) ? 0 : A[iadj2 + jn];
-            T a21 = (in == limit) ? 0 : A[inadj2 + j];
-            T a22 = (in == limit || jn == limit) ? 0 : A[inadj2 + jn];
-            i_type jadj = iadj + j;
-            A11[jadj] = a11;
-            A12[jadj] = a11 + a22;
-            A22[jadj] = a22;
-            S1[jadj] = a21 + a22;
-            S2[jadj] = a11 + a12;
-            S3[jadj] = a21 - a11;
-            S4[jadj] = a12 - a22;
-        }
-    }
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        i_type iadj = i * n;
-        i_type iadj2 = i * limit;
-        i_type inadj2 = in * limit;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T b11 = B[iadj2 + j];
-            T b12 = (jn == limit) ? 0 : B[iadj2 + jn];
-            T b21 = (in == limit) ? 0 : B[inadj2 + j];
-            T b22 = (in == limit || jn == limit) ? 0 : B[inadj2 + jn];
-            i_type jadj = iadj + j;
-            B11[jadj] = b11;
-            B21[jadj] = b11 + b22;
-            B22[jadj] = b22;
-            T1[jadj] = b12 - b22;
-            T2[jadj] = b21 - b11;
-            T3[jadj] = b11 + b12;
-            T4[jadj] = b21 + b22;
-        }
-    }
+    PB::ForwardA(A, lda, 0, m);
+    PB::ForwardB(B, ldb, 0, k);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].first += DURATION(time_p);
 #endif
 
-    next->SW(A12, B21, R1);
-    next->SW(S1, B11, R2);
-    next->SW(A11, T1, R3);
-    next->SW(A22, T2, R4);
-    next->SW(S2, B22, R5);
-    next->SW(S3, T3, R6);
-    next->SW(S4, T4, R7);
+    next->SW(A12, k, B21, n, R1, n);
+    next->SW(S1, k, B11, n, R2, n);
+    next->SW(A11, k, T1, n, R3, n);
+    next->SW(A22, k, T2, n, R4, n);
+    next->SW(S2, k, B22, n, R5, n);
+    next->SW(S3, k, T3, n, R6, n);
+    next->SW(S4, k, T4, n, R7, n);
 
 #ifdef LEVEL_LOAD_TEST__P
     time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in)
-    {
-        i_type iadj = i * n;
-        i_type ciadj = i * limit;
-        i_type cinadj = in * limit;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-        {
-            T r1 = R1[iadj + j];
-            T r2 = R2[iadj + j];
-            T r3 = R3[iadj + j];
-            T r4 = R4[iadj + j];
-            T r5 = R5[iadj + j];
-            C[ciadj + j] = r1 + r4 -r5 + R7[iadj + j];
-            if (jn != limit) C[ciadj + jn] = r3 + r5;
-            if (in != limit) C[cinadj + j] = r2 + r4;
-            if (in != limit && jn != limit) C[cinadj + jn] = r1 + r3 - r2 + R6[iadj + j];
-        }
-    }
+    PB::Backward(C, ldc, 0, m);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].second += DURATION(time_p);
@@ -444,57 +506,111 @@ void Strassen<T>::LevelOdd::SW(const T *A, const T *B, T *C)
 }
 
 template<class T>
-Strassen<T>::PointerBase::PointerBase(i_type n)
-    : n(n)
-{
-    A11 = new T[n * n];
-    A12 = new T[n * n];
-    A22 = new T[n * n];
-    B11 = new T[n * n];
-    B21 = new T[n * n];
-    B22 = new T[n * n];
-    S1 = new T[n * n];
-    S2 = new T[n * n];
-    S3 = new T[n * n];
-    S4 = new T[n * n];
-    T1 = new T[n * n];
-    T2 = new T[n * n];
-    T3 = new T[n * n];
-    T4 = new T[n * n];
-    R1 = new T[n * n];
-    R2 = new T[n * n];
-    R3 = new T[n * n];
-    R4 = new T[n * n];
-    R5 = new T[n * n];
-    R6 = new T[n * n];
-    R7 = new T[n * n];
+void Strassen<T>::PointerBase::ForwardA(const T *A, i_type lda, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Read(A, lda, rm, rk, m, k, from, to,
+        [&](const T *top, const T *bottom, i_type r)
+    {
+        const T *a11 = top;
+        const T *a12 = top + k;
+        const T *a21 = bottom;
+        const T *a22 = bottom + k;
+        if (!window)
+        {
+            std::copy(a11, a11 + k, A11 + r);
+            std::copy(a22, a22 + k, A22 + r);
+        }
+        K.add(k, a11, a22, A12 + r);
+        K.add(k, a21, a22, S1 + r);
+        K.add(k, a11, a12, S2 + r);
+        K.sub(k, a21, a11, S3 + r);
+        K.sub(k, a12, a22, S4 + r);
+    });
 }
 
 template<class T>
-Strassen<T>::PointerBase::~PointerBase()
-{
-    delete[] A11;
-    delete[] A12;
-    delete[] A22;
-    delete[] B11;
-    delete[] B21;
-    delete[] B22;
-    delete[] S1;
-    delete[] S2;
-    delete[] S3;
-    delete[] S4;
-    delete[] T1;
-    delete[] T2;
-    delete[] T3;
-    delete[] T4;
-    delete[] R1;
-    delete[] R2;
-    delete[] R3;
-    delete[] R4;
-    delete[] R5;
-    delete[] R6;
-    delete[] R7;
+void Strassen<T>::PointerBase::ForwardB(const T *B, i_type ldb, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Read(B, ldb, rk, rn, k, n, from, to,
+        [&](const T *top, const T *bottom, i_type r)
+    {
+        const T *b11 = top;
+        const T *b12 = top + n;
+        const T *b21 = bottom;
+        const T *b22 = bottom + n;
+        if (!window)
+        {
+            std::copy(b11, b11 + n, B11 + r);
+            std::copy(b22, b22 + n, B22 + r);
+        }
+        K.add(n, b11, b22, B21 + r);
+        K.sub(n, b12, b22, T1 + r);
+        K.sub(n, b21, b11, T2 + r);
+        K.add(n, b11, b12, T3 + r);
+        K.add(n, b21, b22, T4 + r);
+    });
 }
 
-} // namespace maykitbo
+template<class T>
+void Strassen<T>::PointerBase::Backward(T *C, i_type ldc, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Write(C, ldc, rm, rn, m, n, from, to,
+        [&](T *top, T *bottom, i_type r)
+    {
+        T *c11 = top;
+        T *c12 = top + n;
+        T *c21 = bottom;
+        T *c22 = bottom + n;
+        K.add(n, R3 + r, R5 + r, c12);
+        K.add(n, R2 + r, R4 + r, c21);
+        K.add(n, R1 + r, R4 + r, c11);
+        K.sub(n, c11, R5 + r, c11);
+        K.add(n, c11, R7 + r, c11);
+        K.sub(n, R1 + r, R2 + r, c22);
+        K.add(n, c22, R3 + r, c22);
+        K.add(n, c22, R6 + r, c22);
+    });
+}
+
+template<class T>
+Strassen<T>::PointerBase::PointerBase(i_type m, i_type k, i_type n,
+                                      i_type rm, i_type rk, i_type rn)
+    : m(m), k(k), n(n)
+    , rm(rm), rk(rk), rn(rn)
+    , window(rm == m * 2 && rk == k * 2 && rn == n * 2)
+{}
 
+template<class T>
+std::size_t Strassen<T>::PointerBase::Size() const
+{
+    using W = Workspace<T>;
+    const std::size_t plain = window ? 0 : 2;
+    return W::Round(m * k) * (5 + plain) + W::Round(k * n) * (5 + plain) + W::Round(m * n) * 7;
+}
+
+template<class T>
+T *Strassen<T>::PointerBase::Bind(T *ws)
+{
+    auto take = [&ws](std::initializer_list<T **> bufs, std::size_t size)
+    {
+        for (T **buf : bufs)
+        {
+            *buf = ws;
+            ws += Workspace<T>::Round(size);
+        }
+    };
+    take({&A12, &S1, &S2, &S3, &S4}, m * k);
+    take({&B21, &T1, &T2, &T3, &T4}, k * n);
+    take({&R1, &R2, &R3, &R4, &R5, &R6, &R7}, m * n);
+    if (!window)
+    {
+        take({&A11, &A22}, m * k);
+        take({&B11, &B22}, k * n);
+    }
+    return ws;
+}
+
+} // namespace maykitbo
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "leaf.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace maykitbo {
+
+// Cut-over points of the recursive engines for one element type: the
+// default arguments of Winograd, WinogradP, Strassen and StrassenP.
+// The values below suit the naive leaf, see tuning::Defaults.
+struct Thresholds
+{
+    unsigned winograd_cap = 34;
+    unsigned winogradp_cap = 17;
+    unsigned odd_cap = 25;
+    unsigned strassen_cap = 17;
+    // Smallest dimension from which WinogradP/StrassenP go parallel
+    unsigned parallel_min = 128;
+};
+
+namespace tuning {
+
+using Profile = std::map<std::string, Thresholds>;
+
+// Profile file written by test/winograd/tune: the MAYKITBO_TUNING
+// environment variable, or maykitbo_tuning.txt in $HOME.
+inline std::string ProfilePath()
+{
+    if (const char *env = std::getenv("MAYKITBO_TUNING"))
+        return env;
+    if (const char *home = std::getenv("HOME"))
+        return std::string(home) + "/maykitbo_tuning.txt";
+    return "maykitbo_tuning.txt";
+}
+
+// Built-in thresholds for a leaf. A blocked or BLAS leaf runs several
+// times faster than the naive loop, so recursion stops much earlier:
+// at a few hundred for types with a SIMD microkernel, at about 64 for
+// the portable one.
+inline Thresholds Defaults(Leaf leaf, bool simd)
+{
+    if (leaf == Leaf::Naive)
+        return Thresholds();
+    if (simd)
+        return Thresholds{255, 127, 128, 257, 256};
+    return Thresholds{62, 31, 49, 65, 128};
+}
+
+template<class T>
+Thresholds Defaults(Leaf leaf)
+{
+    return Defaults(leaf, std::is_same_v<T, float> || std::is_same_v<T, double>);
+}
+
+// One "<type> <threshold> <value>" per line, '#' starts a comment.
+// Unknown names are skipped, a missing file gives an empty profile. The
+// thresholds a type leaves out keep the Defaults of leaf.
+inline Profile Load(const std::string &path, Leaf leaf = ActiveLeaf())
+{
+    Profile profile;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string type, name;
+        unsigned value;
+        if (!(fields >> type >> name >> value))
+            continue;
+        auto entry = profile.try_emplace(type, Defaults(leaf, type == "float" || type == "double"));
+        Thresholds &t = entry.first->second;
+        if (name == "winograd_cap") t.winograd_cap = value;
+        else if (name == "winogradp_cap") t.winogradp_cap = value;
+        else if (name == "odd_cap") t.odd_cap = value;
+        else if (name == "strassen_cap") t.strassen_cap = value;
+        else if (name == "parallel_min") t.parallel_min = value;
+    }
+    return profile;
+}
+
+inline bool Save(const std::string &path, const Profile &profile)
+{
+    std::ofstream out(path);
+    out << "# maykitbo tuning profile\n";
+    for (auto &[type, t] : profile)
+    {
+        out << type << " winograd_cap " << t.winograd_cap << '\n'
+            << type << " winogradp_cap " << t.winogradp_cap << '\n'
+            << type << " odd_cap " << t.odd_cap << '\n'
+            << type << " strassen_cap " << t.strassen_cap << '\n'
+            << type << " parallel_min " << t.parallel_min << '\n';
+    }
+    return bool(out);
+}
+
+// Profile of this host, read once on first use
+inline const Profile &Host()
+{
+    static const Profile profile = Load(ProfilePath());
+    return profile;
+}
+
+template<class T> constexpr const char *TypeName() { return nullptr; }
+template<> constexpr const char *TypeName<float>() { return "float"; }
+template<> constexpr const char *TypeName<double>() { return "double"; }
+template<> constexpr const char *TypeName<long double>() { return "long_double"; }
+template<> constexpr const char *TypeName<int>() { return "int"; }
+template<> constexpr const char *TypeName<long>() { return "long"; }
+template<> constexpr const char *TypeName<long long>() { return "long_long"; }
+
+} // namespace tuning
+
+// Thresholds for T from the host profile, or the built-in defaults of
+// the active leaf
+template<class T>
+const Thresholds &Tuned()
+{
+    static const Thresholds *profiled = []() -> const Thresholds *
+    {
+        const char *name = tuning::TypeName<T>();
+        if (name == nullptr)
+            return nullptr;
+        auto found = tuning::Host().find(name);
+        return found != tuning::Host().end() ? &found->second : nullptr;
+    }();
+    static const Thresholds defaults[] = {tuning::Defaults<T>(Leaf::Naive),
+                                          tuning::Defaults<T>(Leaf::Blocked),
+                                          tuning::Defaults<T>(Leaf::Blas)};
+    return profiled ? *profiled : defaults[static_cast<int>(ActiveLeaf())];
+}
+
+} // namespace maykitbo
@@ -1,13 +1,15 @@
 #pragma once
 
 #include "../../matrix.h"
+#include "common.h"
+#include "tuning.h"
 
 #include <vector>
 #include <memory>
-#include <cmath>
+#include <map>
+#include <tuple>
 
 #ifdef LEVEL_LOAD_TEST__P
-    #include <map>
     #include <chrono>
     #define TIME std::chrono::high_resolution_clock::now
     #define DURATION(x) std::chrono::duration_cast<std::chrono::nanoseconds>(TIME() - x).count()
@@ -25,10 +27,35 @@ class Winograd
     using data_t = typename M::base;
 
     public:
-        Winograd(i_type n, i_type winograd_cap = 34);
+        // Default keeps the 15-21 quadrant buffers of every level alive.
+        // LowMemory runs every level on two temporaries and accumulates
+        // the products straight into the quadrants of C (see
+        // LevelLowMemory); odd shapes are padded once into copies.
+        enum class Schedule { Default, LowMemory };
+
+        Winograd(i_type n, i_type winograd_cap = Tuned<T>().winograd_cap);
+        Winograd(i_type m, i_type k, i_type n, i_type winograd_cap = Tuned<T>().winograd_cap);
+        Winograd(i_type m, i_type k, i_type n, i_type winograd_cap, Schedule schedule);
+        // Plan working in a caller-supplied buffer of WorkspaceSize()
+        // elements aligned to Workspace<T>::alignment; one buffer may be
+        // shared by plans that are not executed at the same time
+        Winograd(i_type m, i_type k, i_type n, i_type winograd_cap, T *workspace,
+                 Schedule schedule = Schedule::Default);
         void Execute(const M &A, const M &B, M &C);
-        static void Mul(const M &A, const M &B, M &C, i_type winograd_cap = 34);
-        
+        static void Mul(const M &A, const M &B, M &C, i_type winograd_cap = Tuned<T>().winograd_cap,
+                        Schedule schedule = Schedule::Default);
+
+        // Plans reused by Mul, see PlanCache
+        using Cache = PlanCache<Winograd<T>>;
+        static Cache &Plans();
+
+        // Peak workspace of the plan in elements of T
+        std::size_t WorkspaceSize() const;
+        static std::size_t WorkspaceSize(i_type n, i_type winograd_cap = Tuned<T>().winograd_cap);
+        static std::size_t WorkspaceSize(i_type m, i_type k, i_type n,
+                                         i_type winograd_cap = Tuned<T>().winograd_cap,
+                                         Schedule schedule = Schedule::Default);
+
         virtual ~Winograd() = default;
 
 #ifdef LEVEL_LOAD_TEST__P
@@ -36,52 +63,135 @@ class Winograd
 #else
     protected:
 #endif
-        Winograd() = default;
-        void InitAnalysis(i_type n, i_type winograd_cap);
-
         struct Level;
         struct LevelEven;
         struct LevelAdj;
+        struct LevelSplit;
+        struct LevelPeel;
         struct LevelClassic;
+        struct LevelLowMemory;
+        struct LevelPad;
         struct PointerBase;
-        
-        std::vector<std::unique_ptr<Level>> L_;
-        i_type n_;
+        using Memo = std::map<std::tuple<i_type, i_type, i_type>, Level *>;
 
+        Winograd() = default;
+        void Plan(i_type m, i_type k, i_type n, i_type winograd_cap,
+                  Schedule schedule = Schedule::Default);
+        void Bind(T *workspace);
+        void InitAnalysis(i_type m, i_type k, i_type n, i_type winograd_cap);
+        Level *Build(i_type m, i_type k, i_type n, i_type winograd_cap, Memo &memo);
+        static i_type Padding(i_type (&dims)[3], i_type winograd_cap);
+        static unsigned Depth(i_type step);
+        static void CheckSize(const M &A, const M &B, const M &C);
+
+        template<class L, class... Args>
+        L *Emplace(Args... args);
+
+        std::vector<std::unique_ptr<Level>> L_;
+        i_type m_, k_, n_;
+        Schedule schedule_ = Schedule::Default;
+        Workspace<T> workspace_;
 };
 
 template<class T>
-void Winograd<T>::Mul(const M &A, const M &B, M &C, i_type winograd_cap)
+void Winograd<T>::CheckSize(const M &A, const M &B, const M &C)
 {
-
-    i_type n = A.GetCols();
-    if (n <= 1 || B.GetCols() != n || C.GetCols() != n ||
-        A.GetRows() != n || B.GetRows() != n || C.GetRows() != n)
+    if (A.GetCols() != B.GetRows() || C.GetRows() != A.GetRows() || C.GetCols() != B.GetCols())
     {
         throw std::invalid_argument("Matrix size not match");
     }
-    Winograd<T> W(n, winograd_cap);
-    W.Execute(A, B, C);
+}
+
+template<class T>
+void Winograd<T>::Mul(const M &A, const M &B, M &C, i_type winograd_cap, Schedule schedule)
+{
+    CheckSize(A, B, C);
+    typename Cache::Key key{A.GetRows(), A.GetCols(), B.GetCols(), winograd_cap, 1,
+                            static_cast<i_type>(schedule)};
+    std::unique_ptr<Winograd<T>> W = Plans().Take(key);
+    if (!W)
+        W = std::make_unique<Winograd<T>>(key[0], key[1], key[2], winograd_cap, schedule);
+    W->Execute(A, B, C);
+    std::size_t bytes = W->WorkspaceSize() * sizeof(T);
+    Plans().Give(key, std::move(W), bytes);
+}
+
+template<class T>
+typename Winograd<T>::Cache &Winograd<T>::Plans()
+{
+    static Cache cache;
+    return cache;
+}
+
+template<class T>
+std::size_t Winograd<T>::WorkspaceSize() const
+{
+    std::size_t size = 0;
+    for (auto &level : L_)
+        size += level->Size();
+    return size;
+}
+
+template<class T>
+std::size_t Winograd<T>::WorkspaceSize(i_type n, i_type winograd_cap)
+{
+    return WorkspaceSize(n, n, n, winograd_cap);
+}
+
+template<class T>
+std::size_t Winograd<T>::WorkspaceSize(i_type m, i_type k, i_type n, i_type winograd_cap,
+                                       Schedule schedule)
+{
+    Winograd<T> W;
+    W.Plan(m, k, n, winograd_cap, schedule);
+    return W.WorkspaceSize();
+}
+
+template<class T>
+void Winograd<T>::Bind(T *workspace)
+{
+    for (auto &level : L_)
+        workspace = level->Bind(workspace);
 }
 
 template<class T>
 struct Winograd<T>::Level
 {
-    virtual void SW(const T *A, const T *B, T *C) = 0;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) = 0;
+    // Workspace elements the level needs and binding of its buffers to
+    // the front of ws, returns the rest of ws
+    virtual std::size_t Size() const { return 0; }
+    virtual T *Bind(T *ws) { return ws; }
     Level *next;
     virtual ~Level() = default;
 };
 
+// Buffers of one 2x2x2 step: quadrants are m x k for A, k x n for B and
+// m x n for the products. The parent is rm x rk times rk x rn, at most
+// twice the quadrant size in each dimension; the rest is zero padding.
 template<class T>
 struct Winograd<T>::PointerBase
 {
     T *A11, *A12, *A22, *B11, *B21, *B22;
     T *S1, *S2, *S3, *S4, *T1, *T2, *T3, *T4;
     T *R1, *R2, *R3, *R4, *R5, *R6, *R7;
-    i_type n;
-
-    PointerBase(i_type n);
-    virtual ~PointerBase();
+    i_type m, k, n;
+    i_type rm, rk, rn;
+    // The parent is exactly twice the quadrants: plain quadrants are read
+    // in place as windows of it and get no buffers
+    bool window;
+
+    PointerBase(i_type m, i_type k, i_type n, i_type rm, i_type rk, i_type rn);
+    virtual ~PointerBase() = default;
+
+    std::size_t Size() const;
+    T *Bind(T *ws);
+
+    // Quadrant rows [from, to) of the forward and backward phases,
+    // one vectorized pass per quadrant row.
+    void ForwardA(const T *A, i_type lda, i_type from, i_type to);
+    void ForwardB(const T *B, i_type ldb, i_type from, i_type to);
+    void Backward(T *C, i_type ldc, i_type from, i_type to);
 };
 
 template<class T>
@@ -89,16 +199,18 @@ struct Winograd<T>::LevelEven : public Level, public PointerBase
 {
     using Level::next;
     using PB = PointerBase;
-    using PB::n;
+    using PB::m, PB::k, PB::n;
     using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
         PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
         PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
 
-    LevelEven(i_type n)
-        : PointerBase(n)
+    LevelEven(i_type m, i_type k, i_type n)
+        : PointerBase(m, k, n, m * 2, k * 2, n * 2)
     {}
     virtual ~LevelEven() = default;
-    virtual void SW(const T *A, const T *B, T *C) override;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override { return PB::Size(); }
+    T *Bind(T *ws) override { return PB::Bind(ws); }
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static std::map<i_type, std::pair<int64_t, int64_t>> level_load;
@@ -110,30 +222,77 @@ struct Winograd<T>::LevelAdj : public Level, public PointerBase
 {
     using Level::next;
     using PB = PointerBase;
-    using PB::n;
+    using PB::m, PB::k, PB::n;
     using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
         PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
         PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
-    
-    i_type real_n;
-    LevelAdj(i_type n, i_type real)
-        : PointerBase(n)
-        , real_n(real)
+
+    LevelAdj(i_type m, i_type k, i_type n, i_type real_m, i_type real_k, i_type real_n)
+        : PointerBase(m, k, n, real_m, real_k, real_n)
     {}
     virtual ~LevelAdj() = default;
-    virtual void SW(const T *A, const T *B, T *C) override;
+    virtual void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override { return PB::Size(); }
+    T *Bind(T *ws) override { return PB::Bind(ws); }
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static std::map<i_type, std::pair<int64_t, int64_t>> level_load;
 #endif
 };
 
+template<class T>
+struct Winograd<T>::LevelSplit final : public SplitLevel<T, Level>
+{
+    using SplitLevel<T, Level>::SplitLevel;
+};
+
+template<class T>
+struct Winograd<T>::LevelPeel final : public PeelLevel<T, Level>
+{
+    using PeelLevel<T, Level>::PeelLevel;
+};
+
+// Two-temporary schedule of one 2x2x2 step for a parent of exactly
+// 2m x 2k times 2k x 2n (Boyer, Dumas, Pernet, Zhou 2009). X holds the S
+// sums and then P1, Y the T sums; the other products are computed in
+// place in the quadrants of C and combined there.
+template<class T>
+struct Winograd<T>::LevelLowMemory final : public Level
+{
+    using Level::next;
+    i_type m, k, n;
+    T *X = nullptr, *Y = nullptr;
+
+    LevelLowMemory(i_type m, i_type k, i_type n) : m(m), k(k), n(n) {}
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override;
+    T *Bind(T *ws) override;
+};
+
+// Zero-padded copies of A, B and C for a plan whose every deeper level
+// needs an exact parent
+template<class T>
+struct Winograd<T>::LevelPad final : public Level
+{
+    using Level::next;
+    i_type m, k, n;
+    i_type pm, pk, pn;
+    T *PA = nullptr, *PB = nullptr, *PC = nullptr;
+
+    LevelPad(i_type m, i_type k, i_type n, i_type pm, i_type pk, i_type pn)
+        : m(m), k(k), n(n), pm(pm), pk(pk), pn(pn)
+    {}
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override;
+    T *Bind(T *ws) override;
+};
+
 template<class T>
 struct Winograd<T>::LevelClassic final : public Level
 {
-    i_type n;
-    LevelClassic(i_type n) : n(n) {}
-    void SW(const T *A, const T *B, T *C) override;
+    i_type m, k, n;
+    LevelClassic(i_type m, i_type k, i_type n) : m(m), k(k), n(n) {}
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
 
 #ifdef LEVEL_LOAD_TEST__P
     inline static int64_t load;
@@ -141,61 +300,156 @@ struct Winograd<T>::LevelClassic final : public Level
 };
 
 template<class T>
-void Winograd<T>::InitAnalysis(i_type n, i_type winograd_cap)
+template<class L, class... Args>
+L *Winograd<T>::Emplace(Args... args)
 {
-    if (n <= winograd_cap + 1) {
-        L_.push_back(std::make_unique<LevelClassic>(n));
-        return;
-    }
+    L_.push_back(std::make_unique<L>(args...));
+    return static_cast<L *>(L_.back().get());
+}
 
-    i_type real_n = n;
-    double load_cap = pow(real_n, 3);
-    if (n % 2 == 1) {
-        ++n;
-    }
-    std::pair<i_type, i_type> best = {n, n};
+// Pads every dimension up to a multiple of the same power of two, so that
+// a chain of even levels brings the smallest one under the cap; returns
+// that power of two
+template<class T>
+typename Winograd<T>::i_type Winograd<T>::Padding(i_type (&dims)[3], i_type winograd_cap)
+{
+    i_type lo = std::min({dims[0], dims[1], dims[2]});
+    i_type step = 2;
+    while ((lo + step - 1) / step > winograd_cap + 1)
+        step *= 2;
+    for (i_type &d : dims)
+        d = (d + step - 1) / step * step;
+    return step;
+}
 
-    for (i_type k = n; ; n += 2)
-    {
-        for (k = n; k % 2 == 0; k /= 2) {}
-        if (k < best.first) {
-            best = {k, n};
-        }
-        if (k <= winograd_cap || pow(n, 2.82) >= load_cap)
-            break;
-    }
-    n = best.second;
+// Even levels a padding step of Padding stands for
+template<class T>
+unsigned Winograd<T>::Depth(i_type step)
+{
+    unsigned depth = 0;
+    for (; step > 1; step /= 2)
+        ++depth;
+    return depth;
+}
 
+template<class T>
+typename Winograd<T>::Level *Winograd<T>::Build(i_type m, i_type k, i_type n,
+                                                i_type winograd_cap, Memo &memo)
+{
+    auto found = memo.find({m, k, n});
+    if (found != memo.end())
+        return found->second;
 
-    if (n != real_n)
+    Level *level;
+    typename LevelSplit::Dim dim;
+    if (std::min({m, k, n}) <= winograd_cap + 1)
     {
-        n /= 2;
-        L_.push_back(std::make_unique<LevelAdj>(n, real_n));
+        level = Emplace<LevelClassic>(m, k, n);
     }
-    while (n % 2 == 0 && n > winograd_cap) {
-        n /= 2;
-        L_.push_back(std::make_unique<LevelEven>(n));
+    else if (LevelSplit::Unbalanced(m, k, n, dim))
+    {
+        LevelSplit *split = Emplace<LevelSplit>(dim, m, k, n);
+        i_type first[3], second[3];
+        LevelSplit::Halves(dim, m, k, n, first, second);
+        split->next = Build(first[0], first[1], first[2], winograd_cap, memo);
+        split->next2 = Build(second[0], second[1], second[2], winograd_cap, memo);
+        level = split;
     }
-    L_.push_back(std::make_unique<LevelClassic>(n));
-
-    for (int i = L_.size() - 1; i > 0; --i) {
-        L_[i - 1]->next = &(*L_[i]);
+    else if (schedule_ == Schedule::LowMemory)
+    {
+        i_type p[3] = {m, k, n}, core[3];
+        i_type step = Padding(p, winograd_cap);
+        if (p[0] == m && p[1] == k && p[2] == n)
+        {
+            level = Emplace<LevelLowMemory>(m / 2, k / 2, n / 2);
+            level->next = Build(m / 2, k / 2, n / 2, winograd_cap, memo);
+        }
+        else if (LevelPeel::Cheaper(m, k, n, step, Depth(step), core))
+        {
+            level = Emplace<LevelPeel>(m, k, n, core[0], core[1], core[2]);
+            level->next = Build(core[0], core[1], core[2], winograd_cap, memo);
+        }
+        else
+        {
+            level = Emplace<LevelPad>(m, k, n, p[0], p[1], p[2]);
+            level->next = Build(p[0], p[1], p[2], winograd_cap, memo);
+        }
     }
+    else
+    {
+        i_type p[3] = {m, k, n}, core[3];
+        i_type step = Padding(p, winograd_cap);
+        if (p[0] == m && p[1] == k && p[2] == n)
+        {
+            level = Emplace<LevelEven>(m / 2, k / 2, n / 2);
+            level->next = Build(p[0] / 2, p[1] / 2, p[2] / 2, winograd_cap, memo);
+        }
+        else if (LevelPeel::Cheaper(m, k, n, step, Depth(step), core))
+        {
+            level = Emplace<LevelPeel>(m, k, n, core[0], core[1], core[2]);
+            level->next = Build(core[0], core[1], core[2], winograd_cap, memo);
+        }
+        else
+        {
+            level = Emplace<LevelAdj>(p[0] / 2, p[1] / 2, p[2] / 2, m, k, n);
+            level->next = Build(p[0] / 2, p[1] / 2, p[2] / 2, winograd_cap, memo);
+        }
+    }
+    memo[{m, k, n}] = level;
+    return level;
+}
+
+template<class T>
+void Winograd<T>::InitAnalysis(i_type m, i_type k, i_type n, i_type winograd_cap)
+{
+    Memo memo;
+    Build(m, k, n, winograd_cap, memo);
 }
 
 template<class T>
 Winograd<T>::Winograd(i_type n, i_type winograd_cap)
-    : n_(n)
+    : Winograd(n, n, n, winograd_cap)
+{}
+
+template<class T>
+Winograd<T>::Winograd(i_type m, i_type k, i_type n, i_type winograd_cap)
+{
+    Plan(m, k, n, winograd_cap);
+    Bind(workspace_.Reserve(WorkspaceSize()));
+}
+
+template<class T>
+Winograd<T>::Winograd(i_type m, i_type k, i_type n, i_type winograd_cap, Schedule schedule)
+{
+    Plan(m, k, n, winograd_cap, schedule);
+    Bind(workspace_.Reserve(WorkspaceSize()));
+}
+
+template<class T>
+Winograd<T>::Winograd(i_type m, i_type k, i_type n, i_type winograd_cap, T *workspace,
+                      Schedule schedule)
 {
-    if (n <= 1) {
+    Workspace<T>::CheckAligned(workspace);
+    Plan(m, k, n, winograd_cap, schedule);
+    Bind(workspace);
+}
+
+template<class T>
+void Winograd<T>::Plan(i_type m, i_type k, i_type n, i_type winograd_cap, Schedule schedule)
+{
+    if (m <= 1 || k <= 1 || n <= 1) {
         throw std::invalid_argument("Matrix size must be greater than 1");
     }
+    m_ = m;
+    k_ = k;
+    n_ = n;
+    schedule_ = schedule;
 
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    InitAnalysis(n, winograd_cap);
+    InitAnalysis(m, k, n, winograd_cap);
 
 #ifdef LEVEL_LOAD_TEST__P
     load = DURATION(time_p);
@@ -204,33 +458,24 @@ Winograd<T>::Winograd(i_type n, i_type winograd_cap)
 
 template<class T>
 void Winograd<T>::Execute(const M &A, const M &B, M &C) {
-    if (A.GetCols() != n_ || B.GetCols() != n_ || C.GetCols() != n_ ||
-        A.GetRows() != n_ || B.GetRows() != n_ || C.GetRows() != n_)
+    if (A.GetRows() != m_ || A.GetCols() != k_ || B.GetRows() != k_ ||
+        B.GetCols() != n_ || C.GetRows() != m_ || C.GetCols() != n_)
     {
-        throw std::invalid_argument("Matrix size not match" + std::to_string(n_));
+        throw std::invalid_argument("Matrix size not match " + std::to_string(m_) + "x" +
+                                    std::to_string(k_) + "x" + std::to_string(n_));
     }
-    L_[0]->SW(A.Data(), B.Data(), C.Data());
+    parallel::CheckCancel();
+    L_[0]->SW(A.Data(), k_, B.Data(), n_, C.Data(), n_);
 }
 
 template<class T>
-void Winograd<T>::LevelClassic::SW(const T *A, const T *B, T *C)
+void Winograd<T>::LevelClassic::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    for (i_type i = 0; i < n; ++i)
-    {
-        for (i_type j = 0; j < n; ++j)
-        {
-            T sum = 0;
-            for (i_type k = 0; k < n; ++k)
-            {
-                sum += A[i * n + k] * B[k * n + j];
-            }
-            C[i * n + j] = sum;
-        }
-    }
+    LeafProduct<T>::Mul(m, n, k, A, lda, B, ldb, C, ldc);
 
 #ifdef LEVEL_LOAD_TEST__P
     load += DURATION(time_p);
@@ -238,79 +483,36 @@ void Winograd<T>::LevelClassic::SW(const T *A, const T *B, T *C)
 };
 
 template<class T>
-void Winograd<T>::LevelEven::SW(const T *A, const T *B, T *C)
+void Winograd<T>::LevelEven::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        i_type iadj = i * n;
-        i_type iadj2 = i * n * 2;
-        i_type inadj2 = in * n * 2;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T a11 = A[iadj2 + j];
-            T a12 = A[iadj2 + jn];
-            T a21 = A[inadj2 + j];
-            T a22 = A[inadj2 + jn];
-            i_type jadj = iadj + j;
-            A11[jadj] = a11;
-            A12[jadj] = a12;
-            A22[jadj] = a22;
-            S1[jadj] = a21 + a22;
-            S2[jadj] = a21 + a22 - a11;
-            S3[jadj] = a11 - a21;
-            S4[jadj] = a12 - a21 - a22 + a11;
-        }
-    }
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        i_type iadj = i * n;
-        i_type iadj2 = i * n * 2;
-        i_type inadj2 = in * n * 2;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T b11 = B[iadj2 + j];
-            T b12 = B[iadj2 + jn];
-            T b21 = B[inadj2 + j];
-            T b22 = B[inadj2 + jn];
-            i_type jadj = iadj + j;
-            B11[jadj] = b11;
-            B21[jadj] = b21;
-            B22[jadj] = b22;
-            T1[jadj] = b12 - b11;
-            T2[jadj] = b22 - b12 + b11;
-            T3[jadj] = b22 - b12;
-            T4[jadj] = b22 - b12 + b11 - b21;
-        }
-    }
+    PB::ForwardA(A, lda, 0, m);
+    PB::ForwardB(B, ldb, 0, k);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].first += DURATION(time_p);
 #endif
 
-    next->SW(A11, B11, R1);
-    next->SW(A12, B21, R2);
-    next->SW(S4, B22, R3);
-    next->SW(A22, T4, R4);
-    next->SW(S1, T1, R5);
-    next->SW(S2, T2, R6);
-    next->SW(S3, T3, R7);
+    const T *a12 = A + k;
+    const T *a22 = A + m * lda + k;
+    const T *b21 = B + k * ldb;
+    const T *b22 = b21 + n;
+    next->SW(A, lda, B, ldb, R1, n);
+    next->SW(a12, lda, b21, ldb, R2, n);
+    next->SW(S4, k, b22, ldb, R3, n);
+    next->SW(a22, lda, T4, n, R4, n);
+    next->SW(S1, k, T1, n, R5, n);
+    next->SW(S2, k, T2, n, R6, n);
+    next->SW(S3, k, T3, n, R7, n);
 
 #ifdef LEVEL_LOAD_TEST__P
     time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T r1 = R1[i * n + j];
-            T r7 = R7[i * n + j];
-            T r16 = r1 + R6[i * n + j];
-            T r165 = r16 + R5[i * n + j];
-            C[i * n * 2 + j] = r1 + R2[i * n + j];
-            C[i * n * 2 + jn] = r165 + R3[i * n + j];
-            C[in * n * 2 + j] = r16 - R4[i * n + j] + r7;
-            C[in * n * 2 + jn] = r165 + r7;
-        }
-    }
+    PB::Backward(C, ldc, 0, m);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].second += DURATION(time_p);
@@ -318,82 +520,32 @@ void Winograd<T>::LevelEven::SW(const T *A, const T *B, T *C)
 }
 
 template<class T>
-void Winograd<T>::LevelAdj::SW(const T *A, const T *B, T *C)
+void Winograd<T>::LevelAdj::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
 #ifdef LEVEL_LOAD_TEST__P
     auto time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        i_type iadj = i * n;
-        i_type iadj2 = i * real_n;
-        i_type inadj2 = in * real_n;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T a11 = A[iadj2 + j];
-            T a12 = (jn >= real_n) ? 0 : A[iadj2 + jn];
-            T a21 = (in >= real_n) ? 0 : A[inadj2 + j];
-            T a22 = (in >= real_n || jn >= real_n) ? 0 : A[inadj2 + jn];
-            i_type jadj = iadj + j;
-            A11[jadj] = a11;
-            A12[jadj] = a12;
-            A22[jadj] = a22;
-            S1[jadj] = a21 + a22;
-            S2[jadj] = a21 + a22 - a11;
-            S3[jadj] = a11 - a21;
-            S4[jadj] = a12 - a21 - a22 + a11;
-        }
-    }
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        i_type iadj = i * n;
-        i_type iadj2 = i * real_n;
-        i_type inadj2 = in * real_n;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T b11 = B[iadj2 + j];
-            T b12 = (jn >= real_n) ? 0 : B[iadj2 + jn];
-            T b21 = (in >= real_n) ? 0 : B[inadj2 + j];
-            T b22 = (in >= real_n || jn >= real_n) ? 0 : B[inadj2 + jn];
-            i_type jadj = iadj + j;
-            B11[jadj] = b11;
-            B21[jadj] = b21;
-            B22[jadj] = b22;
-            T1[jadj] = b12 - b11;
-            T2[jadj] = b22 - b12 + b11;
-            T3[jadj] = b22 - b12;
-            T4[jadj] = b22 - b12 + b11 - b21;
-        }
-    }
+    PB::ForwardA(A, lda, 0, m);
+    PB::ForwardB(B, ldb, 0, k);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].first += DURATION(time_p);
 #endif
 
-    next->SW(A11, B11, R1);
-    next->SW(A12, B21, R2);
-    next->SW(S4, B22, R3);
-    next->SW(A22, T4, R4);
-    next->SW(S1, T1, R5);
-    next->SW(S2, T2, R6);
-    next->SW(S3, T3, R7);
+    next->SW(A11, k, B11, n, R1, n);
+    next->SW(A12, k, B21, n, R2, n);
+    next->SW(S4, k, B22, n, R3, n);
+    next->SW(A22, k, T4, n, R4, n);
+    next->SW(S1, k, T1, n, R5, n);
+    next->SW(S2, k, T2, n, R6, n);
+    next->SW(S3, k, T3, n, R7, n);
 
 #ifdef LEVEL_LOAD_TEST__P
     time_p = TIME();
 #endif
 
-    for (i_type i = 0, in = n; i < n; ++i, ++in) {
-        i_type adj = i * n;
-        i_type ciadj = i * real_n;
-        i_type cinadj = in * real_n;
-        for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-            T r1 = R1[adj + j];
-            T r7 = R7[adj + j];
-            T r16 = r1 + R6[adj + j];
-            T r165 = r16 + R5[adj + j];
-            C[ciadj + j] = r1 + R2[adj + j];
-            if (jn < real_n) C[ciadj + jn] = r165 + R3[adj + j];
-            if (in < real_n) C[cinadj + j] = r16 - R4[adj + j] + r7;
-            if (in < real_n && jn < real_n) C[cinadj + jn] = r165 + r7;
-        }
-    }
+    PB::Backward(C, ldc, 0, m);
 
 #ifdef LEVEL_LOAD_TEST__P
     level_load[n].second += DURATION(time_p);
@@ -401,57 +553,211 @@ void Winograd<T>::LevelAdj::SW(const T *A, const T *B, T *C)
 }
 
 template<class T>
-Winograd<T>::PointerBase::PointerBase(i_type n)
-    : n(n)
-{
-    A11 = new T[n * n];
-    A12 = new T[n * n];
-    A22 = new T[n * n];
-    B11 = new T[n * n];
-    B21 = new T[n * n];
-    B22 = new T[n * n];
-    S1 = new T[n * n];
-    S2 = new T[n * n];
-    S3 = new T[n * n];
-    S4 = new T[n * n];
-    T1 = new T[n * n];
-    T2 = new T[n * n];
-    T3 = new T[n * n];
-    T4 = new T[n * n];
-    R1 = new T[n * n];
-    R2 = new T[n * n];
-    R3 = new T[n * n];
-    R4 = new T[n * n];
-    R5 = new T[n * n];
-    R6 = new T[n * n];
-    R7 = new T[n * n];
+std::size_t Winograd<T>::LevelLowMemory::Size() const
+{
+    return Workspace<T>::Round(m * std::max(k, n)) + Workspace<T>::Round(k * n);
 }
 
 template<class T>
-Winograd<T>::PointerBase::~PointerBase()
-{
-    delete[] A11;
-    delete[] A12;
-    delete[] A22;
-    delete[] B11;
-    delete[] B21;
-    delete[] B22;
-    delete[] S1;
-    delete[] S2;
-    delete[] S3;
-    delete[] S4;
-    delete[] T1;
-    delete[] T2;
-    delete[] T3;
-    delete[] T4;
-    delete[] R1;
-    delete[] R2;
-    delete[] R3;
-    delete[] R4;
-    delete[] R5;
-    delete[] R6;
-    delete[] R7;
+T *Winograd<T>::LevelLowMemory::Bind(T *ws)
+{
+    X = ws;
+    Y = X + Workspace<T>::Round(m * std::max(k, n));
+    return Y + Workspace<T>::Round(k * n);
 }
 
-} // namespace maykitbo
+template<class T>
+void Winograd<T>::LevelLowMemory::SW(const T *A, i_type lda, const T *B, i_type ldb,
+                                     T *C, i_type ldc)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    // z = x op y row by row over rows x cols, all with their own strides
+    auto add = [&K](i_type rows, i_type cols, const T *x, i_type ldx,
+                    const T *y, i_type ldy, T *z, i_type ldz)
+    {
+        for (i_type i = 0; i < rows; ++i)
+            K.add(cols, x + i * ldx, y + i * ldy, z + i * ldz);
+    };
+    auto sub = [&K](i_type rows, i_type cols, const T *x, i_type ldx,
+                    const T *y, i_type ldy, T *z, i_type ldz)
+    {
+        for (i_type i = 0; i < rows; ++i)
+            K.sub(cols, x + i * ldx, y + i * ldy, z + i * ldz);
+    };
+
+    const T *a11 = A, *a12 = A + k, *a21 = A + m * lda, *a22 = a21 + k;
+    const T *b11 = B, *b12 = B + n, *b21 = B + k * ldb, *b22 = b21 + n;
+    T *c11 = C, *c12 = C + n, *c21 = C + m * ldc, *c22 = c21 + n;
+
+    sub(m, k, a11, lda, a21, lda, X, k);            // S3
+    sub(k, n, b22, ldb, b12, ldb, Y, n);            // T3
+    next->SW(X, k, Y, n, c21, ldc);                 // P7
+    add(m, k, a21, lda, a22, lda, X, k);            // S1
+    sub(k, n, b12, ldb, b11, ldb, Y, n);            // T1
+    next->SW(X, k, Y, n, c22, ldc);                 // P5
+    sub(m, k, X, k, a11, lda, X, k);                // S2
+    sub(k, n, b22, ldb, Y, n, Y, n);                // T2
+    next->SW(X, k, Y, n, c12, ldc);                 // P6
+    sub(m, k, a12, lda, X, k, X, k);                // S4
+    next->SW(X, k, b22, ldb, c11, ldc);             // P3
+    next->SW(a11, lda, b11, ldb, X, n);             // P1
+    add(m, n, X, n, c12, ldc, c12, ldc);            // U2 = P1 + P6
+    add(m, n, c12, ldc, c21, ldc, c21, ldc);        // U3 = U2 + P7
+    add(m, n, c12, ldc, c22, ldc, c12, ldc);        // U4 = U2 + P5
+    add(m, n, c21, ldc, c22, ldc, c22, ldc);        // C22 = U3 + P5
+    add(m, n, c12, ldc, c11, ldc, c12, ldc);        // C12 = U4 + P3
+    sub(k, n, Y, n, b21, ldb, Y, n);                // T4
+    next->SW(a22, lda, Y, n, c11, ldc);             // P4
+    sub(m, n, c21, ldc, c11, ldc, c21, ldc);        // C21 = U3 - P4
+    next->SW(a12, lda, b21, ldb, c11, ldc);         // P2
+    add(m, n, X, n, c11, ldc, c11, ldc);            // C11 = P1 + P2
+}
+
+template<class T>
+std::size_t Winograd<T>::LevelPad::Size() const
+{
+    using W = Workspace<T>;
+    return W::Round(pm * pk) + W::Round(pk * pn) + W::Round(pm * pn);
+}
+
+template<class T>
+T *Winograd<T>::LevelPad::Bind(T *ws)
+{
+    PA = ws;
+    PB = PA + Workspace<T>::Round(pm * pk);
+    PC = PB + Workspace<T>::Round(pk * pn);
+    return PC + Workspace<T>::Round(pm * pn);
+}
+
+template<class T>
+void Winograd<T>::LevelPad::SW(const T *A, i_type lda, const T *B, i_type ldb,
+                               T *C, i_type ldc)
+{
+    // The padding is cleared on every call, the workspace may be shared
+    for (i_type i = 0; i < pm; ++i)
+    {
+        T *row = PA + i * pk;
+        if (i < m)
+            std::copy(A + i * lda, A + i * lda + k, row);
+        std::fill(row + (i < m ? k : 0), row + pk, T());
+    }
+    for (i_type i = 0; i < pk; ++i)
+    {
+        T *row = PB + i * pn;
+        if (i < k)
+            std::copy(B + i * ldb, B + i * ldb + n, row);
+        std::fill(row + (i < k ? n : 0), row + pn, T());
+    }
+    next->SW(PA, pk, PB, pn, PC, pn);
+    for (i_type i = 0; i < m; ++i)
+        std::copy(PC + i * pn, PC + i * pn + n, C + i * ldc);
+}
 
+template<class T>
+void Winograd<T>::PointerBase::ForwardA(const T *A, i_type lda, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Read(A, lda, rm, rk, m, k, from, to,
+        [&](const T *top, const T *bottom, i_type r)
+    {
+        const T *a11 = top;
+        const T *a12 = top + k;
+        const T *a21 = bottom;
+        const T *a22 = bottom + k;
+        if (!window)
+        {
+            std::copy(a11, a11 + k, A11 + r);
+            std::copy(a12, a12 + k, A12 + r);
+            std::copy(a22, a22 + k, A22 + r);
+        }
+        K.add(k, a21, a22, S1 + r);
+        K.sub(k, S1 + r, a11, S2 + r);
+        K.sub(k, a11, a21, S3 + r);
+        K.sub(k, a12, S2 + r, S4 + r);
+    });
+}
+
+template<class T>
+void Winograd<T>::PointerBase::ForwardB(const T *B, i_type ldb, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Read(B, ldb, rk, rn, k, n, from, to,
+        [&](const T *top, const T *bottom, i_type r)
+    {
+        const T *b11 = top;
+        const T *b12 = top + n;
+        const T *b21 = bottom;
+        const T *b22 = bottom + n;
+        if (!window)
+        {
+            std::copy(b11, b11 + n, B11 + r);
+            std::copy(b21, b21 + n, B21 + r);
+            std::copy(b22, b22 + n, B22 + r);
+        }
+        K.sub(n, b12, b11, T1 + r);
+        K.sub(n, b22, T1 + r, T2 + r);
+        K.sub(n, b22, b12, T3 + r);
+        K.sub(n, T2 + r, b21, T4 + r);
+    });
+}
+
+template<class T>
+void Winograd<T>::PointerBase::Backward(T *C, i_type ldc, i_type from, i_type to)
+{
+    const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+    Quadrants<T>::Write(C, ldc, rm, rn, m, n, from, to,
+        [&](T *top, T *bottom, i_type r)
+    {
+        T *c11 = top;
+        T *c12 = top + n;
+        T *c21 = bottom;
+        T *c22 = bottom + n;
+        K.add(n, R1 + r, R2 + r, c11);
+        K.add(n, R1 + r, R6 + r, c12);
+        K.add(n, c12, R7 + r, c21);
+        K.add(n, c12, R5 + r, c12);
+        K.add(n, c21, R5 + r, c22);
+        K.add(n, c12, R3 + r, c12);
+        K.sub(n, c21, R4 + r, c21);
+    });
+}
+
+template<class T>
+Winograd<T>::PointerBase::PointerBase(i_type m, i_type k, i_type n,
+                                      i_type rm, i_type rk, i_type rn)
+    : m(m), k(k), n(n)
+    , rm(rm), rk(rk), rn(rn)
+    , window(rm == m * 2 && rk == k * 2 && rn == n * 2)
+{}
+
+template<class T>
+std::size_t Winograd<T>::PointerBase::Size() const
+{
+    using W = Workspace<T>;
+    const std::size_t plain = window ? 0 : 3;
+    return W::Round(m * k) * (4 + plain) + W::Round(k * n) * (4 + plain) + W::Round(m * n) * 7;
+}
+
+template<class T>
+T *Winograd<T>::PointerBase::Bind(T *ws)
+{
+    auto take = [&ws](std::initializer_list<T **> bufs, std::size_t size)
+    {
+        for (T **buf : bufs)
+        {
+            *buf = ws;
+            ws += Workspace<T>::Round(size);
+        }
+    };
+    take({&S1, &S2, &S3, &S4}, m * k);
+    take({&T1, &T2, &T3, &T4}, k * n);
+    take({&R1, &R2, &R3, &R4, &R5, &R6, &R7}, m * n);
+    if (!window)
+    {
+        take({&A11, &A12, &A22}, m * k);
+        take({&B11, &B21, &B22}, k * n);
+    }
+    return ws;
+}
+
+} // namespace maykitbo
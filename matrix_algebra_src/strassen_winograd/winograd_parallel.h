@@ -1,11 +1,12 @@
 #pragma once
 
 #include "winograd.h"
+#include "../parallel/thread_pool.h"
 
-#include <vector>
-#include <thread>
-
+#include <limits>
+#include <map>
 #include <memory>
+#include <vector>
 
 namespace maykitbo {
 
@@ -18,389 +19,280 @@ class WinogradP : public Winograd<T>
     using i_type = typename M::i_type;
     using data_t = typename M::base;
     using BW = Winograd<T>;
-    using typename BW::Level, typename BW::LevelEven, typename BW::LevelAdj,
-            typename BW::LevelClassic, typename BW::PointerBase;
-    using BW::L_, BW::n_;
+    using typename BW::Level, typename BW::LevelSplit, typename BW::PointerBase;
+    using LevelShared = SharedLevel<T, Level>;
+    using BW::L_, BW::m_, BW::k_, BW::n_;
 
     public:
-        WinogradP(i_type n, i_type winograd_cap = 17);
-        void Execute(const M &A, const M &B, M &C);
-        static void Mul(const M &A, const M &B, M &C, i_type winograd_cap = 17);
+        WinogradP(i_type n, i_type winograd_cap = Tuned<T>().winogradp_cap);
+        WinogradP(i_type m, i_type k, i_type n,
+                  i_type winograd_cap = Tuned<T>().winogradp_cap);
+        WinogradP(i_type m, i_type k, i_type n, i_type winograd_cap, T *workspace);
+        // On the thread budget of parallel::Threads, see ThreadBudget
+        static void Mul(const M &A, const M &B, M &C,
+                        i_type winograd_cap = Tuned<T>().winogradp_cap);
+
+        // Plans reused by Mul, see PlanCache
+        using Cache = PlanCache<WinogradP<T>>;
+        static Cache &Plans();
+
+        std::size_t WorkspaceSize() const { return BW::WorkspaceSize(); }
+        static std::size_t WorkspaceSize(i_type n,
+                                         i_type winograd_cap = Tuned<T>().winogradp_cap);
+        static std::size_t WorkspaceSize(i_type m, i_type k, i_type n,
+                                         i_type winograd_cap = Tuned<T>().winogradp_cap);
 
     private:
-        struct LevelParallelAdj;
-        struct LevelParallelEven;
-
-        template<class L>
-        void PushLevel(int n);
+        struct LevelParallel;
+
+        WinogradP() = default;
+        void Plan(i_type m, i_type k, i_type n, i_type winograd_cap);
+        // LevelParallel down to products of grain multiply-adds, below it
+        // the shared copies of the plan of Winograd; the plan of Winograd
+        // alone for a top product too small
+        Level *BuildParallel(i_type m, i_type k, i_type n, i_type winograd_cap, double grain,
+                             bool top);
+
+        // Numa mode: home workers of the top products, the buffers of the
+        // parallel levels under each on the node of its home and copy c of
+        // the shared products on the node of worker c; only the homes for
+        // a workspace of the caller, nullptr
+        void Place(T *workspace);
+        using Offsets = std::map<const Level *, std::size_t>;
+        void PlaceSubtree(Level *level, T *workspace, const Offsets &offset, unsigned node);
+
+        // Pool of the thread budget the plan was made for
+        parallel::ThreadPool *pool_ = nullptr;
+        // Products under the last parallel level, if any
+        LevelShared *shared_ = nullptr;
 };
 
 template<class T>
 void WinogradP<T>::Mul(const M &A, const M &B, M &C, i_type winograd_cap)
 {
-    i_type n = A.GetCols();
-    if (n <= 1 || B.GetCols() != n || C.GetCols() != n ||
-        A.GetRows() != n || B.GetRows() != n || C.GetRows() != n)
-    {
-        throw std::invalid_argument("Matrix size not match");
-    }
-    WinogradP<T> W(n, winograd_cap);
-    W.Execute(A, B, C);
+    BW::CheckSize(A, B, C);
+    typename Cache::Key key{A.GetRows(), A.GetCols(), B.GetCols(), winograd_cap,
+                            parallel::Threads(), 0};
+    std::unique_ptr<WinogradP<T>> W = Plans().Take(key);
+    if (!W)
+        W = std::make_unique<WinogradP<T>>(key[0], key[1], key[2], winograd_cap);
+    W->Execute(A, B, C);
+    std::size_t bytes = W->WorkspaceSize() * sizeof(T);
+    Plans().Give(key, std::move(W), bytes);
+}
+
+template<class T>
+typename WinogradP<T>::Cache &WinogradP<T>::Plans()
+{
+    static Cache cache;
+    return cache;
+}
+
+template<class T>
+std::size_t WinogradP<T>::WorkspaceSize(i_type n, i_type winograd_cap)
+{
+    return WorkspaceSize(n, n, n, winograd_cap);
+}
+
+template<class T>
+std::size_t WinogradP<T>::WorkspaceSize(i_type m, i_type k, i_type n, i_type winograd_cap)
+{
+    WinogradP<T> W;
+    W.Plan(m, k, n, winograd_cap);
+    return W.WorkspaceSize();
 }
 
+// The upper levels of the plan, down to products of at most m * k * n /
+// (2 * threads) multiply-adds, two or more per thread of the budget, none
+// for a budget of 1: the forward and backward phases are row chunks for
+// parallel::For and the seven products are stealable tasks; the calling
+// thread runs the last product. The products of the last parallel level
+// share the copies of a SharedLevel.
 template<class T>
-struct WinogradP<T>::LevelParallelEven final : public Level, public BW::PointerBase
+struct WinogradP<T>::LevelParallel final : public Level, public BW::PointerBase
 {
     using BW::Level::next;
     using PB = PointerBase;
-    using PB::n;
+    using PB::m, PB::k, PB::n;
     using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
         PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
         PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
-    
+
     Level *next1, *next2, *next3, *next4, *next5, *next6;
-    LevelParallelEven(i_type n)
-        : PointerBase(n)
+    parallel::ThreadPool *pool = nullptr;
+    int home[7] = {-1, -1, -1, -1, -1, -1, -1};
+    LevelParallel(i_type m, i_type k, i_type n, i_type real_m, i_type real_k, i_type real_n)
+        : PointerBase(m, k, n, real_m, real_k, real_n)
     {}
-    void SW(const T *A, const T *B, T *C) override;
+    void SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc) override;
+    std::size_t Size() const override { return PB::Size(); }
+    // Rows of a forward or backward chunk, about 16K elements
+    static unsigned Grain(i_type cols) { return std::max(1u, (1u << 14) / (2 * cols)); }
+    T *Bind(T *ws) override { return PB::Bind(ws); }
 };
 
 template<class T>
-struct WinogradP<T>::LevelParallelAdj final : public Level, public BW::PointerBase
+WinogradP<T>::WinogradP(i_type n, i_type winograd_cap)
+    : WinogradP(n, n, n, winograd_cap)
+{}
+
+template<class T>
+WinogradP<T>::WinogradP(i_type m, i_type k, i_type n, i_type winograd_cap)
 {
-    using Level::next;
-    using PB = PointerBase;
-    using PB::n;
-    using PB::A11, PB::A12, PB::A22, PB::B11, PB::B21, PB::B22,
-        PB::S1, PB::S2, PB::S3, PB::S4, PB::T1, PB::T2, PB::T3, PB::T4,
-        PB::R1, PB::R2, PB::R3, PB::R4, PB::R5, PB::R6, PB::R7;
-    
-    Level *next1, *next2, *next3, *next4, *next5, *next6;
-    i_type real_n;
-    LevelParallelAdj(i_type n, i_type real)
-        : PointerBase(n)
-        , real_n(real)
-    {}
-    void SW(const T *A, const T *B, T *C) override;
-};
+    Plan(m, k, n, winograd_cap);
+    BW::Bind(BW::workspace_.Reserve(BW::WorkspaceSize()));
+    Place(BW::workspace_.Data());
+}
 
 template<class T>
-template<class L>
-void WinogradP<T>::PushLevel(int n)
+WinogradP<T>::WinogradP(i_type m, i_type k, i_type n, i_type winograd_cap, T *workspace)
 {
-    for (i_type k = 0; k < EVIL; ++k)
-        L_.push_back(std::make_unique<L>(n));
+    Workspace<T>::CheckAligned(workspace);
+    Plan(m, k, n, winograd_cap);
+    BW::Bind(workspace);
+    Place(nullptr);
 }
 
 template<class T>
-WinogradP<T>::WinogradP(i_type n, i_type winograd_cap)
-    : BW()
+void WinogradP<T>::Plan(i_type m, i_type k, i_type n, i_type winograd_cap)
 {
-    if (n <= 1)
+    if (m <= 1 || k <= 1 || n <= 1)
         throw std::invalid_argument("Matrix size must be greater than 1");
 
+    m_ = m;
+    k_ = k;
     n_ = n;
-    if (n <= 128)
+    const unsigned threads = parallel::Threads();
+    pool_ = &parallel::ThreadPool::ForThreads(threads);
+    shared_ = nullptr;
+    const double grain = threads > 1 ? double(m) * k * n / (2.0 * threads)
+                                     : std::numeric_limits<double>::infinity();
+    BuildParallel(m, k, n, winograd_cap, grain, true);
+    // A copy per thread that may run the products at once
+    for (unsigned copy = 0; shared_ != nullptr && copy < pool_->Size(); ++copy)
     {
-        Winograd<T>::InitAnalysis(n, winograd_cap);
-        return;
+        typename BW::Memo memo;
+        shared_->Add(BW::Build(shared_->m, shared_->k, shared_->n, winograd_cap, memo));
     }
-    if (n <= winograd_cap + 1)
-    {
-        L_.push_back(std::make_unique<LevelClassic>(n));
-        return;
-    }
-
-    i_type real_n = n;
-    double load_cap = pow(real_n, 3);
-    if (n % 2 == 1) {
-        ++n;
-    }
-    std::pair<i_type, i_type> best = {n, n};
-
-    for (i_type k = n; ; n += 2)
-    {
-        for (k = n; k % 2 == 0; k /= 2) {}
-        if (k < best.first) {
-            best = {k, n};
-        }
-        if (k <= winograd_cap || pow(n, 2.82) >= load_cap)
-            break;
-    }
-    n = best.second / 2;
-    bool start_adj = (best.second != real_n);
-    if (start_adj)
-        L_.push_back(std::make_unique<LevelParallelAdj>(n, real_n));
-    else
-        L_.push_back(std::make_unique<LevelParallelEven>(n));
-
-    while (n % 2 == 0 && n > winograd_cap) {
-        n /= 2;
-        PushLevel<LevelEven>(n);
-    }
-    PushLevel<LevelClassic>(n);
+}
 
-    Level *front = L_.front().get();
-    front->next = &(*L_[1]);
-    if (start_adj)
+template<class T>
+void WinogradP<T>::Place(T *workspace)
+{
+    auto *top = L_.empty() ? nullptr : dynamic_cast<LevelParallel *>(L_[0].get());
+    if (!parallel::Numa() || top == nullptr || pool_->Home(0) < 0)
+        return;
+    // The calling thread runs the last product, wherever it is
+    for (unsigned t = 0; t < 6; ++t)
+        top->home[t] = pool_->Home(t);
+    if (workspace == nullptr)
+        return;
+    Offsets offset;
+    std::size_t end = 0;
+    for (auto &level : L_)
     {
-        LevelParallelAdj *pol = static_cast<LevelParallelAdj*>(front);
-        pol->next1 = &(*L_[2]);
-        pol->next2 = &(*L_[3]);
-        pol->next3 = &(*L_[4]);
-        pol->next4 = &(*L_[5]);
-        pol->next5 = &(*L_[6]);
-        pol->next6 = &(*L_[7]);
+        offset[level.get()] = end;
+        end += level->Size();
     }
-    else
+    // Every thread works on the buffers of the top level: spread them
+    const std::size_t slice = top->Size() / 6;
+    for (unsigned t = 0; t < 6; ++t)
+        parallel::PlaceMemory(workspace + t * slice, slice * sizeof(T),
+                              static_cast<unsigned>(pool_->Node(top->home[t])));
+    Level *next[6] = {top->next, top->next1, top->next2, top->next3, top->next4, top->next5};
+    for (unsigned t = 0; t < 6; ++t)
+        PlaceSubtree(next[t], workspace, offset, static_cast<unsigned>(pool_->Node(top->home[t])));
+    // The last copy is for threads from outside the pool
+    for (unsigned c = 0; shared_ != nullptr && c + 1 < shared_->copies.size(); ++c)
     {
-        LevelParallelEven *pel = static_cast<LevelParallelEven*>(front);
-        pel->next1 = &(*L_[2]);
-        pel->next2 = &(*L_[3]);
-        pel->next3 = &(*L_[4]);
-        pel->next4 = &(*L_[5]);
-        pel->next5 = &(*L_[6]);
-        pel->next6 = &(*L_[7]);
-    }
-
-    for (i_type i = 1; i < L_.size() - EVIL; ++i) {
-        L_[i]->next = &(*L_[i + EVIL]);
+        const std::size_t from = offset[shared_->copies[c]], to = offset[shared_->copies[c + 1]];
+        parallel::PlaceMemory(workspace + from, (to - from) * sizeof(T),
+                              static_cast<unsigned>(pool_->Node(c)));
     }
 }
 
-
 template<class T>
-void WinogradP<T>::Execute(const M &A, const M &B, M &C)
+void WinogradP<T>::PlaceSubtree(Level *level, T *workspace, const Offsets &offset, unsigned node)
 {
-    if (A.GetCols() != n_ || B.GetCols() != n_ || C.GetCols() != n_ ||
-        A.GetRows() != n_ || B.GetRows() != n_ || C.GetRows() != n_)
-    {
-
-            std::cerr << n_ << ' ' << B.GetCols() << ' ' << C.GetCols() << ' '
-            << A.GetRows() << ' ' << B.GetRows() << ' ' << C.GetRows() << '\n';
-        throw std::invalid_argument("Matrix size not match");
-    }
-    L_[0]->SW(A.Data(), B.Data(), C.Data());
+    auto *split = dynamic_cast<LevelParallel *>(level);
+    if (split == nullptr)
+        return;
+    parallel::PlaceMemory(workspace + offset.at(level), level->Size() * sizeof(T), node);
+    for (Level *next : {split->next, split->next1, split->next2, split->next3, split->next4,
+                        split->next5, split->next6})
+        PlaceSubtree(next, workspace, offset, node);
 }
 
 template<class T>
-void WinogradP<T>::LevelParallelEven::SW(const T *A, const T *B, T *C)
+typename WinogradP<T>::Level *WinogradP<T>::BuildParallel(i_type m, i_type k, i_type n,
+                                                         i_type winograd_cap, double grain,
+                                                         bool top)
 {
-    std::vector<std::thread> thrs;
-    for (unsigned thc = 0; thc < 4; ++thc)
+    typename LevelSplit::Dim dim;
+    i_type lo = std::min({m, k, n});
+    if (double(m) * k * n <= grain || lo <= Tuned<T>().parallel_min || lo <= winograd_cap + 1 ||
+        LevelSplit::Unbalanced(m, k, n, dim))
     {
-        thrs.emplace_back([&, thc]
+        if (!top)
         {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                i_type iadj = i * n;
-                i_type iadj2 = i * n * 2;
-                i_type inadj2 = in * n * 2;
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-                {
-                    T a11 = A[iadj2 + j];
-                    T a12 = A[iadj2 + jn];
-                    T a21 = A[inadj2 + j];
-                    T a22 = A[inadj2 + jn];
-                    i_type jadj = iadj + j;
-                    A11[jadj] = a11;
-                    A12[jadj] = a12;
-                    A22[jadj] = a22;
-                    S1[jadj] = a21 + a22;
-                    S2[jadj] = a21 + a22 - a11;
-                    S3[jadj] = a11 - a21;
-                    S4[jadj] = a12 - a21 - a22 + a11;
-                }
-            }
-        });
-    }
-    for (unsigned thc = 0; thc < 4; ++thc)
-    {
-        thrs.emplace_back([&, thc]
-        {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                i_type iadj = i * n;
-                i_type iadj2 = i * n * 2;
-                i_type inadj2 = in * n * 2;
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-                {
-                    T b11 = B[iadj2 + j];
-                    T b12 = B[iadj2 + jn];
-                    T b21 = B[inadj2 + j];
-                    T b22 = B[inadj2 + jn];
-                    i_type jadj = iadj + j;
-                    B11[jadj] = b11;
-                    B21[jadj] = b21;
-                    B22[jadj] = b22;
-                    T1[jadj] = b12 - b11;
-                    T2[jadj] = b22 - b12 + b11;
-                    T3[jadj] = b22 - b12;
-                    T4[jadj] = b22 - b12 + b11 - b21;
-                }
-            }
-        });
-    }
-    for (auto &i : thrs)
-        i.join();
-
-    thrs.clear();
-
-    std::thread t1(&Level::SW, next, A11, B11, R1);
-    std::thread t2(&Level::SW, next1, A12, B21, R2);
-    std::thread t3(&Level::SW, next2, S4, B22, R3);
-    std::thread t4(&Level::SW, next3, A22, T4, R4);
-    std::thread t5(&Level::SW, next4, S1, T1, R5);
-    std::thread t6(&Level::SW, next5, S2, T2, R6);
-    std::thread t7(&Level::SW, next6, S3, T3, R7);
-
-    t1.join();
-    t2.join();
-    t3.join();
-    t4.join();
-    t5.join();
-    t6.join();
-    t7.join();
-
-    for (unsigned thc = 0; thc < 4; ++thc)
-    {
-        thrs.emplace_back([&, thc]
-        {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-                {
-                    T r1 = R1[i * n + j];
-                    T r7 = R7[i * n + j];
-                    T r16 = r1 + R6[i * n + j];
-                    T r165 = r16 + R5[i * n + j];
-                    C[i * n * 2 + j] = r1 + R2[i * n + j];
-                    C[i * n * 2 + jn] = r165 + R3[i * n + j];
-                    C[in * n * 2 + j] = r16 - R4[i * n + j] + r7;
-                    C[in * n * 2 + jn] = r165 + r7;
-                }
-            }
-        });
+            // The products of every parallel level have one shape
+            if (shared_ == nullptr)
+                shared_ = BW::template Emplace<LevelShared>(m, k, n, pool_);
+            return shared_;
+        }
+        typename BW::Memo memo;
+        return BW::Build(m, k, n, winograd_cap, memo);
     }
-    for (auto &i : thrs)
-        i.join();
+
+    i_type p[3] = {m, k, n};
+    BW::Padding(p, winograd_cap);
+    LevelParallel *level = BW::template Emplace<LevelParallel>(p[0] / 2, p[1] / 2, p[2] / 2, m, k, n);
+    level->pool = pool_;
+    // Tasks running at once never share buffers
+    Level **next[7] = {&level->next, &level->next1, &level->next2, &level->next3,
+                       &level->next4, &level->next5, &level->next6};
+    for (unsigned t = 0; t < 7; ++t)
+        *next[t] = BuildParallel(p[0] / 2, p[1] / 2, p[2] / 2, winograd_cap, grain, false);
+    return level;
 }
 
 template<class T>
-void WinogradP<T>::LevelParallelAdj::SW(const T *A, const T *B, T *C)
+void WinogradP<T>::LevelParallel::SW(const T *A, i_type lda, const T *B, i_type ldb, T *C, i_type ldc)
 {
-
-    std::vector<std::thread> thrs;
-    for (unsigned thc = 0; thc < 4; ++thc)
+    parallel::TaskGroup tasks(*pool);
+    tasks.Run([=] { parallel::For(0, m, Grain(k), [=](i_type from, i_type to)
+                                  { PB::ForwardA(A, lda, from, to); }, *pool); });
+    parallel::For(0, k, Grain(n), [=](i_type from, i_type to) { PB::ForwardB(B, ldb, from, to); },
+                  *pool);
+    tasks.Wait();
+    parallel::CheckCancel();
+
+    const T *a11 = A11, *a12 = A12, *a22 = A22;
+    const T *b11 = B11, *b21 = B21, *b22 = B22;
+    i_type la = k, lb = n;
+    if (PB::window)
     {
-        thrs.emplace_back([&, thc]
-        {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                i_type iadj = i * n;
-                i_type iadj2 = i * real_n;
-                i_type inadj2 = in * real_n;
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn)
-                {
-                    T a11 = A[iadj2 + j];
-                    T a12 = (jn >= real_n) ? 0 : A[iadj2 + jn];
-                    T a21 = (in >= real_n) ? 0 : A[inadj2 + j];
-                    T a22 = (in >= real_n || jn >= real_n) ? 0 : A[inadj2 + jn];
-                    i_type jadj = iadj + j;
-                    A11[jadj] = a11;
-                    A12[jadj] = a12;
-                    A22[jadj] = a22;
-                    S1[jadj] = a21 + a22;
-                    S2[jadj] = a21 + a22 - a11;
-                    S3[jadj] = a11 - a21;
-                    S4[jadj] = a12 - a21 - a22 + a11;
-                }
-            }
-        });
-    }
-    for (unsigned thc = 0; thc < 4; ++thc)
-    {
-        thrs.emplace_back([&, thc]
-        {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                i_type iadj = i * n;
-                i_type iadj2 = i * real_n;
-                i_type inadj2 = in * real_n;
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-                    T b11 = B[iadj2 + j];
-                    T b12 = (jn >= real_n) ? 0 : B[iadj2 + jn];
-                    T b21 = (in >= real_n) ? 0 : B[inadj2 + j];
-                    T b22 = (in >= real_n || jn >= real_n) ? 0 : B[inadj2 + jn];
-                    i_type jadj = iadj + j;
-                    B11[jadj] = b11;
-                    B21[jadj] = b21;
-                    B22[jadj] = b22;
-                    T1[jadj] = b12 - b11;
-                    T2[jadj] = b22 - b12 + b11;
-                    T3[jadj] = b22 - b12;
-                    T4[jadj] = b22 - b12 + b11 - b21;
-                }
-            }
-        });
+        a11 = A;
+        a12 = A + k;
+        a22 = A + m * lda + k;
+        b11 = B;
+        b21 = B + k * ldb;
+        b22 = b21 + n;
+        la = lda;
+        lb = ldb;
     }
-    for (auto &i : thrs)
-        i.join();
-
-    thrs.clear();
-
-    std::thread t1(&Level::SW, next, A11, B11, R1);
-    std::thread t2(&Level::SW, next1, A12, B21, R2);
-    std::thread t3(&Level::SW, next2, S4, B22, R3);
-    std::thread t4(&Level::SW, next3, A22, T4, R4);
-    std::thread t5(&Level::SW, next4, S1, T1, R5);
-    std::thread t6(&Level::SW, next5, S2, T2, R6);
-    std::thread t7(&Level::SW, next6, S3, T3, R7);
-
-    t1.join();
-    t2.join();
-    t3.join();
-    t4.join();
-    t5.join();
-    t6.join();
-    t7.join();
-
-    for (unsigned thc = 0; thc < 4; ++thc)
-    {
-        thrs.emplace_back([&, thc]
-        {
-            unsigned delta = n / 4;
-            unsigned end = (thc == 3 ? n : (thc + 1) * delta);
-            for (i_type i = thc * delta, in = n + thc * delta; i < end; ++i, ++in)
-            {
-                i_type adj = i * n;
-                i_type ciadj = i * real_n;
-                i_type cinadj = in * real_n;
-                for (i_type j = 0, jn = n; j < n; ++j, ++jn) {
-                    T r1 = R1[adj + j];
-                    T r7 = R7[adj + j];
-                    T r16 = r1 + R6[adj + j];
-                    T r165 = r16 + R5[adj + j];
-                    C[ciadj + j] = r1 + R2[adj + j];
-                    if (jn < real_n) C[ciadj + jn] = r165 + R3[adj + j];
-                    if (in < real_n) C[cinadj + j] = r16 - R4[adj + j] + r7;
-                    if (in < real_n && jn < real_n) C[cinadj + jn] = r165 + r7;
-                }
-            }
-        });
-    }
-    for (auto &i : thrs)
-        i.join();
+
+    tasks.RunOn(home[0], [=] { next->SW(a11, la, b11, lb, R1, n); });
+    tasks.RunOn(home[1], [=] { next1->SW(a12, la, b21, lb, R2, n); });
+    tasks.RunOn(home[2], [=] { next2->SW(S4, k, b22, lb, R3, n); });
+    tasks.RunOn(home[3], [=] { next3->SW(a22, la, T4, n, R4, n); });
+    tasks.RunOn(home[4], [=] { next4->SW(S1, k, T1, n, R5, n); });
+    tasks.RunOn(home[5], [=] { next5->SW(S2, k, T2, n, R6, n); });
+    next6->SW(S3, k, T3, n, R7, n);
+    tasks.Wait();
+
+    parallel::For(0, m, Grain(n), [=](i_type from, i_type to) { PB::Backward(C, ldc, from, to); },
+                  *pool);
 }
 
 // } // namespace v2
@@ -2,6 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
 using namespace maykitbo;
 
 TEST(AlgebraTest, matrix_num_sum_static)
@@ -277,3 +282,410 @@ TEST(AlgebraTest, matrix_matrix_sub_operator)
 }
 
 
+TEST(AlgebraTest, matrix_matrix_mul_static)
+{
+    Matrix<int> a
+    {
+        {1, 2, 3},
+        {4, 5, 6}
+    };
+    Matrix<int> b
+    {
+        {7, 8},
+        {9, 10},
+        {11, 12}
+    };
+    Matrix<int> d
+    {
+        {58, 64},
+        {139, 154}
+    };
+    Matrix<int> c(2, 2);
+    Matrix<int>::Algebra::Mul(a, b, c);
+    EXPECT_EQ(d, c);
+    Matrix<int>::Algebra::MulClassic(a, b, c);
+    EXPECT_EQ(d, c);
+    Matrix<int> e(3, 3);
+    EXPECT_ANY_THROW(Matrix<int>::Algebra::Mul(a, b, e));
+    EXPECT_ANY_THROW(Matrix<int>::Algebra::Mul(a, a, c));
+}
+
+TEST(AlgebraTest, matrix_matrix_mul_blocked)
+{
+    const unsigned sizes[][3] = {
+        {1, 1, 1}, {3, 70, 2}, {7, 300, 13}, {64, 64, 64},
+        {130, 257, 65}, {300, 200, 310}, {5, 1100, 600}
+    };
+    for (auto &s : sizes)
+    {
+        Matrix<double> a(s[0], s[1], [](unsigned i, unsigned j) { return (i * 7 + j * 3) % 11 - 5.0; });
+        Matrix<double> b(s[1], s[2], [](unsigned i, unsigned j) { return (i * 5 + j * 2) % 13 - 6.0; });
+        Matrix<double> c1(s[0], s[2]);
+        Matrix<double> c2(s[0], s[2]);
+        Matrix<double>::Algebra::MulClassic(a, b, c1);
+        Matrix<double>::Algebra::MulBlocked(a, b, c2);
+        EXPECT_EQ(c1, c2) << s[0] << 'x' << s[1] << 'x' << s[2];
+    }
+}
+
+TEST(AlgebraTest, matrix_matrix_mul_operator)
+{
+    Matrix<int> a(2, 3, [](unsigned i, unsigned j) { return i + j; });
+    Matrix<int> b(3, 4, [](unsigned i, unsigned j) { return i * j - 1; });
+    Matrix<int> c(2, 4);
+    Matrix<int>::Algebra::MulClassic(a, b, c);
+    EXPECT_EQ(a * b, c);
+    a *= b;
+    EXPECT_EQ(a, c);
+}
+
+TEST(AlgebraTest, matrix_matrix_mul_parallel)
+{
+    for (unsigned threads : {1U, 3U, 8U})
+    {
+        parallel::ThreadBudget budget(threads);
+        for (const auto &s : std::vector<std::array<unsigned, 3>>{
+                 {1, 1, 1}, {300, 200, 250}, {517, 33, 401}, {9, 700, 611}, {1100, 64, 7}})
+        {
+            Matrix<long> a(s[0], s[1], [](unsigned i, unsigned j) { return long(i * 3 + j) % 17 - 8; });
+            Matrix<long> b(s[1], s[2], [](unsigned i, unsigned j) { return long(i + j * 5) % 13 - 6; });
+            Matrix<long> expected(s[0], s[2]), c(s[0], s[2], [] { return 99L; });
+            Matrix<long>::Algebra::MulClassic(a, b, expected);
+            Matrix<long>::Algebra::MulParallel(a, b, c);
+            EXPECT_EQ(c, expected) << threads << ' ' << s[0] << 'x' << s[1] << 'x' << s[2];
+        }
+    }
+
+    // Four tiles a thread, whole register tiles but at the edges
+    const Gemm<double>::Kernel kernel = Gemm<double>::GetKernel();
+    const Gemm<double>::Tiling tile = Gemm<double>::GetTiling(kernel, 1000, 1000, 8);
+    EXPECT_EQ(tile.rows % kernel.mr, 0U);
+    EXPECT_EQ(tile.cols % kernel.nr, 0U);
+    EXPECT_GE(((1000 + tile.rows - 1) / tile.rows) * ((1000 + tile.cols - 1) / tile.cols), 32U);
+
+    Matrix<double> a(120, 120, [](unsigned i, unsigned j) { return i * 0.5 - j; });
+    Matrix<double> expected(120, 120);
+    Matrix<double>::Algebra::MulClassic(a, a, expected);
+    parallel::ThreadBudget budget(4);
+    Matrix<double>::Algebra::MulParallel(a, a, a);
+    EXPECT_EQ(a, expected);
+    Matrix<double> wrong(119, 120);
+    EXPECT_ANY_THROW(Matrix<double>::Algebra::MulParallel(a, a, wrong));
+}
+
+TEST(AlgebraTest, matrix_matrix_mul_async)
+{
+    std::vector<Matrix<long>> a, b, c, expected;
+    for (unsigned k = 0; k < 6; ++k)
+    {
+        const unsigned m = 40 + 70 * k, inner = 300 - 30 * k, n = 90 + 50 * k;
+        a.emplace_back(m, inner, [k](unsigned i, unsigned j) { return long(i * 3 + j + k) % 17 - 8; });
+        b.emplace_back(inner, n, [k](unsigned i, unsigned j) { return long(i + j * 5 + k) % 13 - 6; });
+        c.emplace_back(m, n);
+        expected.emplace_back(m, n);
+        Matrix<long>::Algebra::MulClassic(a[k], b[k], expected[k]);
+    }
+    std::vector<std::future<MulAlgorithm>> products;
+    for (unsigned k = 0; k < 6; ++k)
+        products.push_back(Matrix<long>::Algebra::MulAsync(a[k], b[k], c[k]));
+    for (unsigned k = 0; k < 6; ++k)
+    {
+        // The algorithm comes with the product, whichever thread ran it
+        EXPECT_EQ(products[k].get(),
+                  SelectMul<long>(a[k].GetRows(), a[k].GetCols(), b[k].GetCols())) << k;
+        EXPECT_EQ(c[k], expected[k]) << k;
+    }
+
+    std::promise<std::exception_ptr> finished;
+    Matrix<long> d(a[1].GetRows(), b[1].GetCols());
+    Matrix<long>::Algebra::MulAsync(a[1], b[1], d, [&](std::exception_ptr error) { finished.set_value(error); });
+    EXPECT_EQ(finished.get_future().get(), nullptr);
+    EXPECT_EQ(d, expected[1]);
+    EXPECT_THROW(Matrix<long>::Algebra::MulAsync(a[0], a[0], d), std::runtime_error);
+
+    // Errors reach the future or the callback, the budget goes with the task
+    std::future<int> failing = parallel::Async([]() -> int { throw std::logic_error("task"); });
+    EXPECT_THROW(failing.get(), std::logic_error);
+    std::promise<bool> failed;
+    parallel::Async([] { throw std::logic_error("task"); },
+                    [&](std::exception_ptr error) { failed.set_value(error != nullptr); });
+    EXPECT_TRUE(failed.get_future().get());
+    std::promise<void> dropped;
+    parallel::Async([] {}, [&](std::exception_ptr)
+    {
+        dropped.set_value();
+        throw std::logic_error("done");
+    });
+    dropped.get_future().get();
+    parallel::ThreadBudget budget(3);
+    EXPECT_EQ(parallel::Async([] { return parallel::Threads(); }).get(), 3U);
+}
+
+TEST(AlgebraTest, matrix_matrix_mul_cancel)
+{
+    Matrix<double> a(300, 300, [](unsigned i, unsigned j) { return double(i * 7 + j) / 300; });
+    Matrix<double> c(300, 300), expected(300, 300);
+    Matrix<double>::Algebra::MulClassic(a, a, expected);
+    parallel::CancelToken token;
+    token.Cancel();
+    {
+        parallel::CancelScope scope(token);
+        EXPECT_TRUE(parallel::CancelToken::Current().Cancelled());
+        EXPECT_THROW(Matrix<double>::Algebra::MulClassic(a, a, c), parallel::Cancelled);
+        EXPECT_THROW(Matrix<double>::Algebra::MulBlocked(a, a, c), parallel::Cancelled);
+        EXPECT_THROW(Matrix<double>::Algebra::MulParallel(a, a, c), parallel::Cancelled);
+        // The scope goes with the task, the stop comes through the future
+        std::future<MulAlgorithm> product = Matrix<double>::Algebra::MulAsync(a, a, c);
+        EXPECT_THROW(product.get(), parallel::Cancelled);
+
+        // Tasks of a stopped product never run
+        bool ran = false;
+        parallel::TaskGroup tasks;
+        tasks.Run([&ran] { ran = true; });
+        EXPECT_THROW(tasks.Wait(), parallel::Cancelled);
+        EXPECT_FALSE(ran);
+    }
+    EXPECT_FALSE(parallel::CancelToken::Current().Stopped());
+    Matrix<double>::Algebra::MulClassic(a, a, c);
+    EXPECT_EQ(c, expected);
+
+    Matrix<double> big(1000, 1000, [](unsigned i, unsigned j) { return double(i + j); });
+    Matrix<double> result(1000, 1000);
+    parallel::CancelScope scope(parallel::CancelToken::After(std::chrono::milliseconds(1)));
+    try
+    {
+        Matrix<double>::Algebra::MulClassic(big, big, result);
+        FAIL() << "deadline missed";
+    }
+    catch (const parallel::Cancelled &stop)
+    {
+        EXPECT_TRUE(stop.Expired());
+    }
+}
+
+TEST(AlgebraTest, simd_dispatch)
+{
+    using simd::Isa;
+    const Isa best = simd::DetectIsa();
+    EXPECT_LE(simd::ActiveIsa(), best);
+    EXPECT_EQ(simd::SetIsa(Isa::AVX512), best);
+
+    for (Isa isa : {Isa::Generic, Isa::SSE2, Isa::AVX2, Isa::AVX512})
+    {
+        if (isa > best)
+            break;
+        EXPECT_EQ(simd::SetIsa(isa), isa);
+        EXPECT_EQ(simd::Kernels<float>::Get().isa, isa);
+        EXPECT_EQ(simd::Kernels<int>::Get().isa, Isa::Generic);
+
+        Matrix<float> a(37, 91, [](unsigned i, unsigned j) { return (i * 7 + j * 3) % 11 - 5.0f; });
+        Matrix<float> b(91, 53, [](unsigned i, unsigned j) { return (i * 5 + j * 2) % 13 - 6.0f; });
+        Matrix<float> c1(37, 53), c2(37, 53);
+        Matrix<float>::Algebra::MulClassic(a, b, c1);
+        Matrix<float>::Algebra::MulBlocked(a, b, c2);
+        EXPECT_EQ(c1, c2) << simd::IsaName(isa);
+
+        Matrix<double> d(19, 23, [](unsigned i, unsigned j) { return i - 2.0 * j; });
+        Matrix<double> e(19, 23, [](unsigned i, unsigned j) { return 0.5 * i * j; });
+        Matrix<double> sum = d + e, diff = d - e, scaled = d * 3.0, shifted = d + 1.5;
+        d.ForEach([&](unsigned i, unsigned j, const double &v)
+        {
+            EXPECT_EQ(sum(i, j), v + e(i, j));
+            EXPECT_EQ(diff(i, j), v - e(i, j));
+            EXPECT_EQ(scaled(i, j), v * 3.0);
+            EXPECT_EQ(shifted(i, j), v + 1.5);
+        });
+
+        // Streaming kernels from every alignment of the result
+        const simd::Kernels<double> &K = simd::Kernels<double>::Get();
+        std::vector<double> x(203), y(203), z1(203), z2(203);
+        for (unsigned k = 0; k < x.size(); ++k)
+        {
+            x[k] = k * 0.5 - 20;
+            y[k] = 7.0 - k;
+        }
+        for (unsigned offset = 0; offset < 9; ++offset)
+        {
+            const unsigned size = 194 - offset;
+            K.add(size, &x[offset], &y[offset], &z1[offset]);
+            K.add_stream(size, &x[offset], &y[offset], &z2[offset]);
+            EXPECT_EQ(z1, z2) << simd::IsaName(isa) << ' ' << offset;
+            K.sub(size, &x[offset], &y[offset], &z1[offset]);
+            K.sub_stream(size, &x[offset], &y[offset], &z2[offset]);
+            EXPECT_EQ(z1, z2) << simd::IsaName(isa) << ' ' << offset;
+            K.scale(size, &x[offset], -3.0, &z1[offset]);
+            K.scale_stream(size, &x[offset], -3.0, &z2[offset]);
+            EXPECT_EQ(z1, z2) << simd::IsaName(isa) << ' ' << offset;
+            K.add_scalar(size, &x[offset], 2.5, &z1[offset]);
+            K.add_scalar_stream(size, &x[offset], 2.5, &z2[offset]);
+            EXPECT_EQ(z1, z2) << simd::IsaName(isa) << ' ' << offset;
+        }
+
+        // Ragged edges around the tiles of every width
+        Matrix<float> f(35, 21, [](unsigned i, unsigned j) { return i * 100.0f + j; });
+        Matrix<double> g(18, 43, [](unsigned i, unsigned j) { return i - j * 0.5; });
+        Matrix<float> ft(21, 35);
+        Matrix<double> gt(43, 18);
+        Matrix<float>::Algebra::Transpose(f, ft);
+        Matrix<double>::Algebra::Transpose(g, gt);
+        f.ForEach([&](unsigned i, unsigned j, const float &v) { EXPECT_EQ(ft(j, i), v); });
+        g.ForEach([&](unsigned i, unsigned j, const double &v) { EXPECT_EQ(gt(j, i), v); });
+
+        // One tile straight through the kernel, between wider rows
+        auto tile = [isa](auto zero)
+        {
+            using T = decltype(zero);
+            const simd::Kernels<T> &K = simd::Kernels<T>::Get();
+            const unsigned side = K.tile, lds = side + 3, ldd = side + 5;
+            std::vector<T> from(side * lds), to(side * ldd, T(-1));
+            for (unsigned k = 0; k < from.size(); ++k)
+                from[k] = T(k);
+            K.transpose(from.data(), lds, to.data(), ldd);
+            for (unsigned i = 0; i < side; ++i)
+                for (unsigned j = 0; j < side; ++j)
+                    EXPECT_EQ(to[j * ldd + i], from[i * lds + j]) << simd::IsaName(isa) << ' ' << i << ' ' << j;
+        };
+        tile(0.0f);
+        tile(0.0);
+
+        // Windows starting off the cache lines, split off before the tiles
+        std::vector<float> source(96 * 80), target(96 * 80);
+        for (unsigned k = 0; k < source.size(); ++k)
+            source[k] = float(k);
+        for (unsigned offset : {0U, 1U, 5U, 15U})
+        {
+            std::fill(target.begin(), target.end(), -1.0f);
+            Transposition<float>::Run(70, 60, &source[offset], 80, &target[3 * offset], 96);
+            for (unsigned i = 0; i < 70; ++i)
+                for (unsigned j = 0; j < 60; ++j)
+                    ASSERT_EQ(target[3 * offset + j * 96 + i], source[offset + i * 80 + j])
+                        << simd::IsaName(isa) << ' ' << offset << ' ' << i << ' ' << j;
+        }
+    }
+    simd::SetIsa(best);
+}
+
+TEST(AlgebraTest, elementwise_parallel)
+{
+    // Above the split size, and past the last-level cache for streaming
+    const unsigned side = 1500;
+    Matrix<double> a(side, side, [](unsigned i, unsigned j) { return i * 0.25 - j; });
+    Matrix<double> b(side, side, [](unsigned i, unsigned j) { return (i + j) % 7 - 3.0; });
+    for (unsigned threads : {1U, 4U})
+    {
+        SetMulThreads(threads);
+        Matrix<double> sum = a + b, diff = a - b, scaled = a * 2.0, divided = a / 4.0;
+        Matrix<double> shifted = a - 1.0, negated = -a, in_place(a);
+        in_place += b;
+        for (unsigned i = 0; i < side; i += 37)
+        {
+            for (unsigned j = 0; j < side; j += 13)
+            {
+                EXPECT_EQ(sum(i, j), a(i, j) + b(i, j));
+                EXPECT_EQ(diff(i, j), a(i, j) - b(i, j));
+                EXPECT_EQ(scaled(i, j), a(i, j) * 2.0);
+                EXPECT_EQ(divided(i, j), a(i, j) / 4.0);
+                EXPECT_EQ(shifted(i, j), a(i, j) - 1.0);
+                EXPECT_EQ(negated(i, j), -a(i, j));
+                EXPECT_EQ(in_place(i, j), sum(i, j));
+            }
+        }
+        EXPECT_EQ(sum(side - 1, side - 1), a(side - 1, side - 1) + b(side - 1, side - 1));
+    }
+    SetMulThreads(0);
+}
+
+TEST(AlgebraTest, transpose)
+{
+    for (auto [rows, cols] : {std::array<unsigned, 2>{1, 1}, {1, 300}, {300, 1}, {7, 13},
+                              {64, 64}, {129, 65}, {517, 300}, {1000, 700}})
+    {
+        Matrix<long> a(rows, cols, [](unsigned i, unsigned j) { return long(i) * 10000 + j; });
+        for (unsigned threads : {1U, 4U})
+        {
+            SetMulThreads(threads);
+            Matrix<long> t = Matrix<long>::Algebra::Transpose(a);
+            ASSERT_EQ(t.GetRows(), cols);
+            ASSERT_EQ(t.GetCols(), rows);
+            a.ForEach([&](unsigned i, unsigned j, const long &v) { EXPECT_EQ(t(j, i), v); });
+        }
+    }
+    SetMulThreads(0);
+
+    Matrix<double> square(300, 300, [](unsigned i, unsigned j) { return i * 0.5 - j; });
+    Matrix<double> copy(square), transposed(300, 300);
+    Matrix<double>::Algebra::Transpose(square, transposed);
+    Matrix<double>::Algebra::Transpose(square, square);
+    EXPECT_EQ(square, transposed);
+    copy.ForEach([&](unsigned i, unsigned j, const double &v) { EXPECT_EQ(square(j, i), v); });
+    Matrix<double> wrong(300, 200);
+    EXPECT_THROW(Matrix<double>::Algebra::Transpose(square, wrong), std::runtime_error);
+}
+
+TEST(AlgebraTest, mul_dispatch)
+{
+    SetMulThreads(1);
+    EXPECT_EQ(SelectMul<int>(8, 8, 8), MulAlgorithm::Classic);
+    EXPECT_EQ(SelectMul<double>(64, 64, 64), MulAlgorithm::Blocked);
+    EXPECT_EQ(SelectMul<int>(1024, 1024, 1024), MulAlgorithm::Winograd);
+    EXPECT_EQ(SelectMul<double>(1024, 1024, 1024), MulAlgorithm::Blocked);
+    SetMulThreads(4);
+    EXPECT_EQ(SelectMul<double>(100, 100, 100), MulAlgorithm::Blocked);
+    EXPECT_EQ(SelectMul<long>(1024, 1024, 1024), MulAlgorithm::WinogradP);
+    EXPECT_EQ(SelectMul<float>(1024, 1024, 1024), MulAlgorithm::Blocked);
+    EXPECT_EQ(SelectMul<float>(1024, 8, 1024), MulAlgorithm::Blocked);
+    SetMulThreads(0);
+    EXPECT_GE(MulThreads(), 1U);
+
+    Matrix<long> a(300, 200, [](unsigned i, unsigned j) { return long(i * 3 + j) % 17 - 8; });
+    Matrix<long> b(200, 250, [](unsigned i, unsigned j) { return long(i + j * 5) % 13 - 6; });
+    Matrix<long> expected(300, 250);
+    Matrix<long>::Algebra::MulClassic(a, b, expected);
+    for (MulAlgorithm algorithm : {MulAlgorithm::Classic, MulAlgorithm::Blocked,
+                                   MulAlgorithm::Winograd, MulAlgorithm::WinogradP,
+                                   MulAlgorithm::Strassen, MulAlgorithm::StrassenP})
+    {
+        PinMul(algorithm);
+        EXPECT_EQ(SelectMul<long>(1024, 1024, 1024), algorithm);
+        EXPECT_EQ(a * b, expected) << MulAlgorithmName(algorithm);
+        EXPECT_EQ(LastMul(), algorithm);
+    }
+
+    // A pinned engine gives way on the shapes it cannot run a level of
+    Matrix<double> row(1, 5, [](unsigned, unsigned j) { return j + 1.0; });
+    Matrix<double> column(5, 3, [](unsigned i, unsigned j) { return i * 2.0 - j; });
+    Matrix<double> product(1, 3);
+    Matrix<double>::Algebra::MulClassic(row, column, product);
+    for (MulAlgorithm algorithm : {MulAlgorithm::Winograd, MulAlgorithm::WinogradP,
+                                   MulAlgorithm::Strassen, MulAlgorithm::StrassenP})
+    {
+        PinMul(algorithm);
+        EXPECT_EQ(SelectMul<double>(1, 1024, 1024), MulAlgorithm::Blocked);
+        EXPECT_EQ(SelectMul<long>(1024, 1024, detail::EngineCap<long>(algorithm) + 1),
+                  MulAlgorithm::Blocked);
+        EXPECT_EQ(row * column, product) << MulAlgorithmName(algorithm);
+        EXPECT_EQ(LastMul(), MulAlgorithm::Blocked);
+        EXPECT_EQ(Matrix<double>::Algebra::Transpose(column) * Matrix<double>::Algebra::Transpose(row),
+                  Matrix<double>::Algebra::Transpose(product));
+    }
+    PinMul(MulAlgorithm::Auto);
+    Matrix<long> c = a * b;
+    EXPECT_EQ(c, expected);
+    EXPECT_EQ(LastMul(), SelectMul<long>(300, 200, 250));
+    // Only the products a thread runs itself
+    std::thread([]
+    {
+        EXPECT_EQ(LastMul(), MulAlgorithm::Auto);
+        Matrix<long> x(4, 4), y(4, 4);
+        Matrix<long> z = x * y;
+        EXPECT_EQ(LastMul(), MulAlgorithm::Classic);
+    }).join();
+    EXPECT_EQ(LastMul(), SelectMul<long>(300, 200, 250));
+
+    Matrix<long> square(64, 64, [](unsigned i, unsigned j) { return long(i) - long(j); });
+    Matrix<long> squared(64, 64);
+    Matrix<long>::Algebra::MulClassic(square, square, squared);
+    Matrix<long>::Algebra::Mul(square, square, square);
+    EXPECT_EQ(square, squared);
+    EXPECT_ANY_THROW(Matrix<long>::Algebra::Mul(a, a, c));
+}
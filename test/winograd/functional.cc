@@ -1,20 +1,41 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <thread>
+
 #include "../utility/m_random.h"
 #include "../../matrix_algebra.h"
 
 #ifdef WINOGRAD
     #include "strassen_winograd/winograd.h"
+    #include "strassen_winograd/fixed.h"
+    #include "strassen_winograd/morton.h"
+    #include "strassen_winograd/stability.h"
     #define CLASS_NAME Winograd
+    #define FIXED_NAME FixedWinograd
+    #define CAPS 17
 #elif defined WINOGRADP
     #include "strassen_winograd/winograd_parallel.h"
     #define CLASS_NAME WinogradP
+    #define CAPS 17
 #elif defined STRASSEN
     #include "strassen_winograd/strassen.h"
+    #include "strassen_winograd/fixed.h"
+    #include "strassen_winograd/bilinear.h"
+    #include "strassen_winograd/planner.h"
+    #include "strassen_winograd/stability.h"
     #define CLASS_NAME Strassen
+    #define FIXED_NAME FixedStrassen
+    #define CAPS 17, 17
 #elif defined STRASSENP
     #include "strassen_winograd/strassen_parallel.h"
     #define CLASS_NAME StrassenP
+    #define CAPS 17, 17
 #else
     #error "No algorithm defined"
 #endif
@@ -46,7 +67,23 @@ void Functional(unsigned int N,
         T random_min = static_cast<T>(-10),
         T random_max = static_cast<T>(10)) {
     
-    Helper<T>(N, random_min, random_max, CLASS_NAME<T>(N));  
+    Helper<T>(N, random_min, random_max, CLASS_NAME<T>(N, CAPS));
+}
+
+
+template<class T>
+void Rectangular(unsigned int m, unsigned int k, unsigned int n) {
+    Matrix<T> A(m, k, [&] { return Random::Easy<T>::R(-10, 10); });
+    Matrix<T> B(k, n, [&] { return Random::Easy<T>::R(-10, 10); });
+    Matrix<T> C1(m, n);
+    auto C2 = A * B;
+    CLASS_NAME<T>::Mul(A, B, C1, CAPS);
+    C1.SetComparePrecision(1e-5);
+    if (C1 != C2)
+    {
+        std::cout << '\t' << m << 'x' << k << 'x' << n << '\n';
+        EXPECT_FALSE(true);
+    }
 }
 
 
@@ -98,13 +135,609 @@ TEST(FUNCTIONAL_CLASS(CLASS_NAME), __from_129x129_to_512x512) {
     Functional<int>(512);
 }
 
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __rectangular) {
+    Rectangular<int>(5, 6, 5);
+    Rectangular<int>(5, 6, 7);
+    Rectangular<double>(300, 40, 70);
+    Rectangular<double>(17, 513, 9);
+    Rectangular<int>(1000, 64, 64);
+    Rectangular<int>(64, 1000, 64);
+    Rectangular<double>(129, 300, 257);
+    Rectangular<long>(200, 201, 199);
+    Rectangular<double>(250, 260, 270);
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __peeling) {
+    Rectangular<int>(129, 129, 129);
+    Rectangular<int>(131, 130, 257);
+    Rectangular<double>(257, 129, 131);
+    Rectangular<int>(99, 101, 97);
+    Rectangular<long>(1011, 67, 130);
+#if defined WINOGRAD || defined STRASSEN
+    // 129 peels down to the core of 128 instead of padding to 136
+    EXPECT_EQ(CLASS_NAME<double>::WorkspaceSize(129, CAPS),
+              CLASS_NAME<double>::WorkspaceSize(128, CAPS));
+#endif
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __leaf) {
+    for (Leaf leaf : {Leaf::Naive, Leaf::Blocked, Leaf::Blas}) {
+        SetLeaf(leaf);
+        Rectangular<int>(131, 130, 257);
+        Rectangular<double>(200, 201, 199);
+        Functional<long>(96);
+    }
+    EXPECT_EQ(SetLeaf(Leaf::Blocked), Leaf::Blocked);
+}
+
+#ifdef FIXED_NAME
+template<class T, class F>
+void Fixed(unsigned m, unsigned k, unsigned n) {
+    Matrix<T> A(m, k, [&] { return Random::Easy<T>::R(-10, 10); });
+    Matrix<T> B(k, n, [&] { return Random::Easy<T>::R(-10, 10); });
+    Matrix<T> C1(m, n), C2(m, n);
+    F::Mul(A, B, C1);
+    Gemm<T>::Mul(m, n, k, A.Data(), k, B.Data(), n, C2.Data(), n);
+    C1.SetComparePrecision(1e-5);
+    EXPECT_TRUE(C1 == C2) << m << 'x' << k << 'x' << n;
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __fixed) {
+    Fixed<int, FIXED_NAME<int, 256, 256, 256, 31>>(256, 256, 256);
+    Fixed<int, FIXED_NAME<int, 512>>(512, 512, 512);
+    Fixed<long, FIXED_NAME<long, 1024>>(1024, 1024, 1024);
+    Fixed<double, FIXED_NAME<double, 64, 128, 32, 7>>(64, 128, 32);
+
+    static_assert(FIXED_NAME<double, 2048>::Depth() == 4);
+    static_assert(FIXED_NAME<double, 256, 256, 256, 255>::WorkspaceSize() == 0);
+    FIXED_NAME<float, 256> plan;
+    Matrix<float> A(256, 256), B(256, 256), C(256, 255);
+    EXPECT_ANY_THROW(plan.Execute(A, B, C));
+}
+#endif
+
+#if defined WINOGRAD || defined STRASSEN
+// |C - A B|max / (|A|max |B|max) against a double reference
+double RelativeError(const Matrix<float> &A, const Matrix<float> &B, const Matrix<float> &C) {
+    auto wide = [](const Matrix<float> &X) {
+        return Matrix<double>(X.GetRows(), X.GetCols(), [&](unsigned i, unsigned j) { return double(X(i, j)); });
+    };
+    Matrix<double> exact = wide(A) * wide(B), computed = wide(C);
+    double error = 0;
+    for (unsigned i = 0; i < C.GetRows(); ++i)
+        for (unsigned j = 0; j < C.GetCols(); ++j)
+            error = std::max(error, std::abs(computed(i, j) - exact(i, j)));
+    return error / (stability::MaxNorm(A) * stability::MaxNorm(B));
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __stability) {
+    using S = Stable<float, CLASS_NAME>;
+    EXPECT_EQ(stability::Growth(12, 5, 2, 1), 62);
+    EXPECT_EQ(stability::Growth(18, 6, 64, 0), 64 * 64);
+
+    Matrix<float> A(512, 512, [] { return Random::Easy<float>::R(-1, 1); });
+    Matrix<float> B(512, 512, [] { return Random::Easy<float>::R(-1, 1); });
+    StabilityReport loose = S::Plan(A, B, {1e-2}, 17);
+    EXPECT_GT(loose.depth, 0U);
+    EXPECT_EQ(loose.depth, loose.natural_depth);
+    EXPECT_TRUE(loose.met);
+    StabilityReport never = S::Plan(A, B, {1e-7}, 17);
+    EXPECT_EQ(never.depth, 0U);
+    EXPECT_FALSE(never.met);
+
+    Matrix<float> C(512, 512);
+    StabilityReport tight = S::Mul(A, B, C, {2e-4}, 17);
+    EXPECT_GT(tight.depth, 0U);
+    EXPECT_LT(tight.depth, loose.depth);
+    EXPECT_TRUE(tight.met);
+    EXPECT_LE(RelativeError(A, B, C), 2e-4);
+
+    // Columns of A and rows of B of opposite scale: balancing them
+    // allows more levels for the same tolerance, exactly
+    Matrix<float> SA(A), SB(B);
+    for (unsigned i = 0; i < 512; ++i)
+        for (unsigned p = 1; p < 512; p += 2) {
+            SA(i, p) *= 65536.0f;
+            SB(p, i) /= 65536.0f;
+        }
+    StabilityReport plain = S::Plan(SA, SB, {2e-4}, 17);
+    StabilityReport scaled = S::Mul(SA, SB, C, {2e-4, true}, 17);
+    EXPECT_FALSE(plain.scaled);
+    EXPECT_TRUE(scaled.scaled);
+    EXPECT_GT(scaled.depth, plain.depth);
+    EXPECT_LE(RelativeError(SA, SB, C), 2e-4);
+    EXPECT_ANY_THROW(S::Mul(A, B, SA = Matrix<float>(512, 511), {1e-2}));
+}
+#endif
+
+#if defined WINOGRADP || defined STRASSENP
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __thread_pool) {
+    using parallel::TaskGroup;
+    using parallel::ThreadPool;
+    EXPECT_EQ(&ThreadPool::Shared(), &ThreadPool::Shared());
+    EXPECT_GE(ThreadPool::Shared().Size(), 1U);
+
+    // Nested groups make progress on any pool size, even with no workers
+    for (unsigned workers : {0U, 1U, 3U}) {
+        ThreadPool pool(workers);
+        std::atomic<unsigned> count{0};
+        TaskGroup outer(pool);
+        for (unsigned i = 0; i < 8; ++i)
+            outer.Run([&] {
+                TaskGroup inner(pool);
+                for (unsigned j = 0; j < 8; ++j)
+                    inner.Run([&] { ++count; });
+                inner.Wait();
+            });
+        outer.Wait();
+        EXPECT_EQ(count.load(), 64U);
+
+        TaskGroup failing(pool);
+        failing.Run([] { throw std::runtime_error("task"); });
+        failing.Run([&] { ++count; });
+        EXPECT_THROW(failing.Wait(), std::runtime_error);
+        EXPECT_EQ(count.load(), 65U);
+
+        // Every index once, no chunk above the grain
+        std::vector<std::atomic<unsigned>> hits(1000);
+        std::atomic<unsigned> widest{0};
+        parallel::For(3, 1000, 16, [&](unsigned from, unsigned to) {
+            for (unsigned i = from; i < to; ++i)
+                ++hits[i];
+            unsigned width = to - from;
+            for (unsigned w = widest; w < width && !widest.compare_exchange_weak(w, width);) {}
+        }, pool);
+        for (unsigned i = 0; i < hits.size(); ++i)
+            EXPECT_EQ(hits[i].load(), i < 3 ? 0U : 1U);
+        EXPECT_LE(widest.load(), 16U);
+        parallel::For(5, 5, 1, [&](unsigned, unsigned) { ++count; }, pool);
+        EXPECT_EQ(count.load(), 65U);
+    }
+
+    // Enough 7-way levels for two tasks a thread
+    EXPECT_EQ(ThreadPool(0).Depth(7), 1U);
+    EXPECT_EQ(ThreadPool(6).Depth(7), 2U);
+    EXPECT_EQ(ThreadPool(63).Depth(7), 3U);
+
+    // Budgets follow the affinity mask and scopes, pools follow budgets
+    const std::vector<unsigned> cpus = parallel::Cpus();
+    EXPECT_FALSE(cpus.empty());
+    EXPECT_GE(parallel::AvailableThreads(), 1U);
+    EXPECT_LE(parallel::AvailableThreads(), cpus.size());
+    EXPECT_EQ(parallel::Threads(), parallel::AvailableThreads());
+    // The quota is read where /proc/self/cgroup places the process
+    const std::string cgroups = "12:cpuset:/other\n4:cpu,cpuacct:/kubepods/pod1\n0::/system.slice/app\n";
+    EXPECT_EQ(parallel::detail::ParseCgroup(cgroups, true), "/system.slice/app");
+    EXPECT_EQ(parallel::detail::ParseCgroup(cgroups, false), "/kubepods/pod1");
+    EXPECT_EQ(parallel::detail::ParseCgroup("3:memory:/x\n", false), "");
+    {
+        // A limit on the parent applies to the child without one
+        const std::string root = "cgroup_test";
+        std::filesystem::create_directories(root + "/slice/app");
+        std::ofstream(root + "/slice/cpu.max") << "150000 100000\n";
+        std::ofstream(root + "/slice/app/cpu.max") << "max 100000\n";
+        EXPECT_EQ(parallel::detail::CgroupQuota(root + "/slice/app", true), 0);
+        EXPECT_DOUBLE_EQ(parallel::detail::TightestQuota(root, "/slice/app", true), 1.5);
+        EXPECT_DOUBLE_EQ(parallel::detail::TightestQuota(root, "/missing/app", true), 0);
+        std::filesystem::remove_all(root);
+    }
+    {
+        parallel::ThreadBudget outer(3);
+        EXPECT_EQ(parallel::Threads(), 3U);
+        {
+            parallel::ThreadBudget inner(1);
+            EXPECT_EQ(parallel::Threads(), 1U);
+            EXPECT_EQ(ThreadPool::ForThreads().Size(), 1U);
+            Rectangular<int>(300, 310, 290);
+        }
+        EXPECT_EQ(parallel::Threads(), 3U);
+        EXPECT_LE(ThreadPool::ForThreads().Size(), 3U);
+        Rectangular<int>(300, 310, 290);
+    }
+    EXPECT_EQ(&ThreadPool::ForThreads(1000), &ThreadPool::Shared());
+    {
+        // Parallel levels down to the grain, the products below them
+        // share a copy of their buffers per thread of the pool
+        parallel::ThreadBudget budget(8);
+        const std::size_t threads = ThreadPool::ForThreads().Size();
+        const std::size_t parallel = CLASS_NAME<int>::WorkspaceSize(1024, CAPS);
+        {
+            parallel::ThreadBudget sequential(1);
+            EXPECT_LE(parallel, (threads + 2) * CLASS_NAME<int>::WorkspaceSize(1024, CAPS));
+        }
+        Rectangular<int>(300, 310, 290);
+        Rectangular<int>(517, 260, 301);
+    }
+    {
+        ThreadPool pinned(2, true);
+        std::atomic<unsigned> count{0};
+        parallel::For(0, 100, 1, [&](unsigned from, unsigned to) { count += to - from; }, pinned);
+        EXPECT_EQ(count.load(), 100U);
+    }
+
+    // NUMA: nodes cover the allowed CPUs, homes need two pinned nodes
+    EXPECT_EQ(parallel::detail::ParseCpuList("0-2,5,7-8\n"),
+              (std::vector<unsigned>{0, 1, 2, 5, 7, 8}));
+    std::size_t node_cpus = 0;
+    for (const auto &node : parallel::Nodes())
+        node_cpus += node.second.size();
+    EXPECT_EQ(node_cpus, cpus.size());
+    {
+        ThreadPool unpinned(3);
+        EXPECT_EQ(unpinned.Home(0), -1);
+        EXPECT_EQ(unpinned.Node(2), -1);
+        std::atomic<unsigned> count{0};
+        TaskGroup homed(unpinned);
+        for (int worker : {-1, 0, 2, 3})
+            homed.RunOn(worker, [&] { ++count; });
+        homed.Wait();
+        EXPECT_EQ(count.load(), 4U);
+    }
+    {
+        // Posted tasks are for idle workers, never for a waiting thread
+        ThreadPool idle(0);
+        bool ran = false;
+        idle.Post([&] { ran = true; });
+        EXPECT_FALSE(idle.RunOne());
+        EXPECT_FALSE(ran);
+        ThreadPool one(1);
+        std::promise<void> posted;
+        one.Post([&] { posted.set_value(); });
+        posted.get_future().get();
+    }
+    parallel::SetNuma(true);
+    Rectangular<int>(302, 310, 290);
+    // Budget pools are pinned in Numa mode too
+    if (ThreadPool::Shared().Size() > 2) {
+        EXPECT_GE(ThreadPool::ForThreads(2).Node(0), 0);
+    }
+    {
+        // The buffers of a workspace of the caller stay where they are
+        parallel::ThreadBudget budget(8);
+        Workspace<int> workspace(CLASS_NAME<int>::WorkspaceSize(300, 310, 290, CAPS));
+        CLASS_NAME<int> W(300, 310, 290, CAPS, workspace.Data());
+        Matrix<int> A(300, 310, [&] { return Random::Easy<int>::R(-10, 10); });
+        Matrix<int> B(310, 290, [&] { return Random::Easy<int>::R(-10, 10); });
+        Matrix<int> C(300, 290);
+        W.Execute(A, B, C);
+        EXPECT_EQ(C, A * B);
+    }
+    parallel::SetNuma(false);
+    if (ThreadPool::Shared().Size() > 2) {
+        EXPECT_EQ(ThreadPool::ForThreads(2).Node(0), -1);
+    }
+    EXPECT_FALSE(parallel::Numa());
+    {
+        // Numa mode needs two nodes, and is off for good once mbind refuses
+        parallel::SetNuma(true);
+        EXPECT_EQ(parallel::Numa(), parallel::Nodes().size() > 1);
+        std::vector<char> pages(1 << 16);
+        EXPECT_FALSE(parallel::PlaceMemory(pages.data(), pages.size(), 63));
+        EXPECT_FALSE(parallel::Numa());
+        parallel::SetNuma(false);
+    }
+
+    // Products running on the shared pool from several threads at once;
+    // Random is not thread-safe, the operands are made here
+    Matrix<int> A(300, 310, [&] { return Random::Easy<int>::R(-10, 10); });
+    Matrix<int> B(310, 290, [&] { return Random::Easy<int>::R(-10, 10); });
+    const Matrix<int> expected = A * B;
+    std::vector<std::thread> callers;
+    for (unsigned i = 0; i < 3; ++i)
+        callers.emplace_back([&] {
+            Matrix<int> C(300, 290);
+            CLASS_NAME<int>::Mul(A, B, C, CAPS);
+            EXPECT_EQ(C, expected);
+        });
+    for (std::thread &caller : callers)
+        caller.join();
+}
+#endif
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __rectangular_execute) {
+    Matrix<int> A(150, 300, [&] { return Random::Easy<int>::R(-10, 10); });
+    Matrix<int> B(300, 200, [&] { return Random::Easy<int>::R(-10, 10); });
+    Matrix<int> C(150, 200);
+    CLASS_NAME<int> W(150, 300, 200, 17);
+    W.Execute(A, B, C);
+    EXPECT_EQ(C, A * B);
+    EXPECT_ANY_THROW(W.Execute(B, A, C));
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __workspace) {
+    std::size_t size = std::max(CLASS_NAME<double>::WorkspaceSize(200, 150, 260, CAPS),
+                                CLASS_NAME<double>::WorkspaceSize(300, CAPS));
+    Workspace<double> workspace(size);
+    CLASS_NAME<double> W1(200, 150, 260, CAPS, workspace.Data());
+    CLASS_NAME<double> W2(300, 300, 300, CAPS, workspace.Data());
+    EXPECT_LE(W1.WorkspaceSize(), size);
+    EXPECT_EQ(W2.WorkspaceSize(), CLASS_NAME<double>::WorkspaceSize(300, CAPS));
+
+    Matrix<double> A(200, 150, [&] { return Random::Easy<double>::R(-10, 10); });
+    Matrix<double> B(150, 260, [&] { return Random::Easy<double>::R(-10, 10); });
+    Matrix<double> C(200, 260), D(300, 300);
+    Matrix<double> E(300, 300, [&] { return Random::Easy<double>::R(-10, 10); });
+    for (int k = 0; k < 2; ++k) {
+        W1.Execute(A, B, C);
+        C.SetComparePrecision(1e-6);
+        EXPECT_EQ(C, A * B);
+        W2.Execute(E, E, D);
+        D.SetComparePrecision(1e-6);
+        EXPECT_EQ(D, E * E);
+    }
+    EXPECT_ANY_THROW(CLASS_NAME<double>(300, 300, 300, CAPS, workspace.Data() + 1));
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __plan_cache) {
+    auto &plans = CLASS_NAME<int>::Plans();
+    plans.Clear();
+    Matrix<int> A(140, 150, [&] { return Random::Easy<int>::R(-10, 10); });
+    Matrix<int> B(150, 160, [&] { return Random::Easy<int>::R(-10, 10); });
+    Matrix<int> C(140, 160);
+    for (int k = 0; k < 3; ++k) {
+        CLASS_NAME<int>::Mul(A, B, C);
+        EXPECT_EQ(C, A * B);
+        EXPECT_EQ(plans.Size(), 1U);
+    }
+    std::vector<std::thread> thrs;
+    for (int k = 0; k < 4; ++k)
+        thrs.emplace_back([&] {
+            Matrix<int> D(140, 160);
+            CLASS_NAME<int>::Mul(A, B, D);
+            EXPECT_EQ(D, A * B);
+        });
+    for (auto &t : thrs)
+        t.join();
+    EXPECT_LE(plans.Size(), 5U);
+    EXPECT_GE(plans.Size(), 1U);
+
+    plans.SetLimit(plans.Bytes() / 2);
+    EXPECT_LE(plans.Bytes(), plans.Limit());
+    plans.SetLimit(0);
+    EXPECT_EQ(plans.Size(), 0U);
+    CLASS_NAME<int>::Mul(A, B, C);
+    EXPECT_EQ(plans.Size(), 0U);
+    plans.SetLimit(PlanCache<CLASS_NAME<int>>::default_limit);
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __cancel) {
+    auto &plans = CLASS_NAME<double>::Plans();
+    plans.Clear();
+    Matrix<double> A(1500, 1500, [&] { return Random::Easy<double>::R(-10, 10); });
+    Matrix<double> C(1500, 1500);
+    parallel::CancelToken token;
+    {
+        parallel::CancelScope scope(token);
+        std::thread canceller([&] { token.Cancel(); });
+        try {
+            CLASS_NAME<double>::Mul(A, A, C);
+            canceller.join();
+            FAIL() << "not cancelled";
+        } catch (const parallel::Cancelled &stop) {
+            canceller.join();
+            EXPECT_FALSE(stop.Expired());
+        }
+        // Plans of stopped products are freed, not cached
+        EXPECT_EQ(plans.Size(), 0U);
+    }
+    {
+        parallel::CancelScope scope(parallel::CancelToken::After(std::chrono::milliseconds(1)));
+        try {
+            CLASS_NAME<double>::Mul(A, A, C);
+            FAIL() << "deadline missed";
+        } catch (const parallel::Cancelled &stop) {
+            EXPECT_TRUE(stop.Expired());
+        }
+    }
+    Matrix<double> B(200, 200, [&] { return Random::Easy<double>::R(-10, 10); });
+    Matrix<double> D(200, 200);
+    CLASS_NAME<double>::Mul(B, B, D);
+    D.SetComparePrecision(1e-6);
+    EXPECT_EQ(D, B * B);
+}
+
+#ifdef WINOGRAD
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __low_memory) {
+    using W = Winograd<double>;
+    for (auto [m, k, n] : {std::tuple{256u, 256u, 256u}, {301u, 299u, 257u},
+                           {100u, 300u, 160u}, {517u, 130u, 129u}}) {
+        Matrix<double> A(m, k, [&] { return Random::Easy<double>::R(-10, 10); });
+        Matrix<double> B(k, n, [&] { return Random::Easy<double>::R(-10, 10); });
+        Matrix<double> C(m, n);
+        W::Mul(A, B, C, 17, W::Schedule::LowMemory);
+        C.SetComparePrecision(1e-6);
+        EXPECT_EQ(C, A * B);
+    }
+    EXPECT_LT(W::WorkspaceSize(512, 512, 512, 17, W::Schedule::LowMemory),
+              W::WorkspaceSize(512, 512, 512, 17) / 4);
+    EXPECT_LT(W::WorkspaceSize(511, 511, 511, 17, W::Schedule::LowMemory),
+              W::WorkspaceSize(511, 511, 511, 17));
+}
+#endif
+
+#ifdef WINOGRAD
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __tuning_profile) {
+    std::string path = testing::TempDir() + "maykitbo_tuning_test.txt";
+    tuning::Profile profile;
+    profile["double"].winograd_cap = 60;
+    profile["double"].parallel_min = 300;
+    profile["float"].odd_cap = 40;
+    ASSERT_TRUE(tuning::Save(path, profile));
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "# comment\nint strassen_cap 33 # tail\nint unknown 1\nbroken line\n";
+    }
+    tuning::Profile loaded = tuning::Load(path);
+    EXPECT_EQ(loaded["double"].winograd_cap, 60U);
+    EXPECT_EQ(loaded["double"].parallel_min, 300U);
+    EXPECT_EQ(loaded["float"].odd_cap, 40U);
+    EXPECT_EQ(loaded["int"].strassen_cap, 33U);
+    EXPECT_EQ(loaded.size(), 3U);
+    EXPECT_TRUE(tuning::Load(path + ".missing").empty());
+
+    // A profile setting one threshold keeps the leaf defaults of the rest
+    {
+        std::ofstream out(path);
+        out << "double strassen_cap 300\nint odd_cap 20\n";
+    }
+    for (Leaf leaf : {Leaf::Naive, Leaf::Blocked})
+    {
+        tuning::Profile partial = tuning::Load(path, leaf);
+        Thresholds expected = tuning::Defaults<double>(leaf);
+        expected.strassen_cap = 300;
+        const Thresholds &got = partial["double"];
+        EXPECT_EQ(got.winograd_cap, expected.winograd_cap);
+        EXPECT_EQ(got.winogradp_cap, expected.winogradp_cap);
+        EXPECT_EQ(got.odd_cap, expected.odd_cap);
+        EXPECT_EQ(got.strassen_cap, expected.strassen_cap);
+        EXPECT_EQ(got.parallel_min, expected.parallel_min);
+        EXPECT_EQ(partial["int"].odd_cap, 20U);
+        EXPECT_EQ(partial["int"].winograd_cap, tuning::Defaults<int>(leaf).winograd_cap);
+    }
+    EXPECT_NE(tuning::Defaults<double>(Leaf::Blocked).winograd_cap, Thresholds().winograd_cap);
+    std::remove(path.c_str());
+}
+#endif
+
+#ifdef WINOGRAD
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __morton_layout) {
+    Matrix<int> A(37, 70, [](unsigned i, unsigned j) { return int(i * 100 + j); });
+    for (unsigned depth : {0U, 1U, 3U}) {
+        MortonMatrix<int> M(A, depth);
+        EXPECT_EQ(M.Size() % (1U << (2 * depth)), 0U);
+        EXPECT_EQ(M(36, 69), 3669);
+        EXPECT_EQ(M(5, 0), 500);
+        EXPECT_TRUE(M.ToMatrix() == A);
+    }
+    EXPECT_ANY_THROW(MortonMatrix<int>(A, 2).Assign(Matrix<int>(37, 71)));
+    // Checked before any allocation
+    EXPECT_THROW(MortonMatrix<int>(0, 70, 3), std::invalid_argument);
+    EXPECT_THROW(MortonMatrix<int>(37, 0, 3), std::invalid_argument);
+    EXPECT_THROW(MortonMatrix<int>(37, 70, 32), std::invalid_argument);
+    EXPECT_THROW(MortonMatrix<int>(37, 70, 31), std::length_error);
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __morton_product) {
+    for (auto [m, k, n] : {std::array<unsigned, 3>{256, 256, 256}, {150, 300, 200}, {129, 67, 131}}) {
+        Matrix<long> A(m, k, [] { return Random::Easy<long>::R(-10, 10); });
+        Matrix<long> B(k, n, [] { return Random::Easy<long>::R(-10, 10); });
+        Matrix<long> C = A * B;
+        unsigned depth = MortonMatrix<long>::Levels(m, k, n, 17);
+        MortonMatrix<long> MA(A, depth), MB(B, depth), MC(m, n, depth);
+        MortonWinograd<long>::Mul(MA, MB, MC);
+        EXPECT_TRUE(MC.ToMatrix() == C) << m << 'x' << k << 'x' << n;
+    }
+
+    // Mul plans a shape and depth once
+    auto &plans = MortonWinograd<long>::Plans();
+    plans.Clear();
+    Matrix<long> E(150, 300, [] { return Random::Easy<long>::R(-10, 10); });
+    Matrix<long> F(300, 200, [] { return Random::Easy<long>::R(-10, 10); });
+    MortonMatrix<long> ME(E, 3), MF(F, 3), MG(150, 200, 3);
+    for (int k = 0; k < 3; ++k) {
+        MortonWinograd<long>::Mul(ME, MF, MG);
+        EXPECT_TRUE(MG.ToMatrix() == E * F);
+        EXPECT_EQ(plans.Size(), 1U);
+    }
+    MortonMatrix<long> MH(E, 2), MI(F, 2), MJ(150, 200, 2);
+    MortonWinograd<long>::Mul(MH, MI, MJ);
+    EXPECT_TRUE(MJ.ToMatrix() == E * F);
+    EXPECT_EQ(plans.Size(), 2U);
+
+    // A chain stays in the layout: (A * B) * B
+    Matrix<long> A(96, 96, [] { return Random::Easy<long>::R(-5, 5); });
+    Matrix<long> B(96, 96, [] { return Random::Easy<long>::R(-5, 5); });
+    MortonMatrix<long> MA(A, 2), MB(B, 2), MC(96, 96, 2), MD(96, 96, 2);
+    MortonWinograd<long> plan(96, 96, 96, 2);
+    plan.Execute(MA, MB, MC);
+    plan.Execute(MC, MB, MD);
+    EXPECT_TRUE(MD.ToMatrix() == A * B * B);
+    MortonMatrix<long> shallow(96, 96, 1);
+    EXPECT_ANY_THROW(plan.Execute(MA, MB, shallow));
+}
+#endif
+
+#ifdef STRASSEN
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __bilinear_schemes) {
+    for (const BilinearScheme *s : {&schemes::Strassen(), &schemes::Winograd(), &schemes::Laderman()})
+        EXPECT_TRUE(s->Valid()) << s->name;
+    EXPECT_TRUE(schemes::Classic(2, 3, 4).Valid());
+    EXPECT_NEAR(schemes::Strassen().Exponent(), 2.807, 1e-3);
+
+    BilinearScheme broken = schemes::Strassen();
+    broken.W[0] = 0;
+    EXPECT_FALSE(broken.Valid());
+    EXPECT_ANY_THROW(Bilinear<int>(64, 64, 64, broken, 8));
+    EXPECT_ANY_THROW(BilinearScheme::Parse("bad", 2, 2, 2, {"a11 + b11"}, {}));
+    EXPECT_ANY_THROW(BilinearScheme::Parse("bad", 2, 2, 2, {"a31 * b11"}, {}));
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __bilinear_product) {
+    for (const BilinearScheme &s : {schemes::Strassen(), schemes::Winograd(), schemes::Laderman(),
+                                    schemes::Classic(2, 3, 2)}) {
+        for (auto [m, k, n] : {std::array<unsigned, 3>{81, 81, 81}, {100, 100, 100},
+                               {150, 300, 200}, {67, 129, 41}}) {
+            Matrix<long> A(m, k, [] { return Random::Easy<long>::R(-10, 10); });
+            Matrix<long> B(k, n, [] { return Random::Easy<long>::R(-10, 10); });
+            Matrix<long> C(m, n);
+            Bilinear<long> plan(m, k, n, s, 8);
+            EXPECT_GT(plan.Depth(), 0U);
+            plan.Execute(A, B, C);
+            EXPECT_TRUE(C == A * B) << s.name << ' ' << m << 'x' << k << 'x' << n;
+        }
+    }
+    Matrix<double> A(90, 90, [] { return Random::Easy<double>::R(-1, 1); });
+    Matrix<double> C(90, 90);
+    Bilinear<double>::Mul(A, A, C, schemes::Laderman(), 9);
+    C.SetComparePrecision(1e-9);
+    EXPECT_TRUE(C == A * A);
+    EXPECT_ANY_THROW(Bilinear<double>::Mul(A, Matrix<double>(91, 90), C, schemes::Laderman()));
+}
+
+TEST(FUNCTIONAL_CLASS(CLASS_NAME), __bilinear_planner) {
+    EXPECT_TRUE(schemes::Join(schemes::Strassen(), schemes::Classic(2, 2, 1), 'n').Valid());
+    EXPECT_TRUE(schemes::Join(schemes::Strassen(), schemes::Strassen(), 'k').Valid());
+    EXPECT_ANY_THROW(schemes::Join(schemes::Strassen(), schemes::Laderman(), 'm'));
+
+    BilinearPlanner planner(BilinearPlanner::DefaultSchemes(), {0.05});
+    EXPECT_EQ(planner.Plan(99, 99, 99).schemes[planner.Plan(99, 99, 99).nodes[0].scheme].name,
+              "laderman");
+    for (auto [m, k, n] : {std::array<unsigned, 3>{66, 400, 400}, {99, 99, 99}, {150, 300, 200}}) {
+        BilinearPlan plan = planner.Plan(m, k, n);
+        for (std::size_t i = 1; i < plan.nodes.size(); ++i)
+            EXPECT_LT(plan.nodes[i].cost, plan.nodes[i - 1].cost) << plan.ToString();
+        Matrix<long> A(m, k, [] { return Random::Easy<long>::R(-10, 10); });
+        Matrix<long> B(k, n, [] { return Random::Easy<long>::R(-10, 10); });
+        Matrix<long> C(m, n);
+        Bilinear<long>(plan).Execute(A, B, C);
+        EXPECT_TRUE(C == A * B) << plan.ToString();
+    }
+    // 66x400x400 runs Strassen down to 9x50x50, then <3,2,2;11>
+    BilinearPlan mixed = planner.Plan(66, 400, 400);
+    EXPECT_NE(mixed.nodes[0].scheme, mixed.nodes[mixed.nodes.size() - 2].scheme) << mixed.ToString();
+
+    // A plan that does not divide into its next level is rejected
+    mixed.nodes[1].m += 1;
+    EXPECT_ANY_THROW(Bilinear<long>{mixed});
+    EXPECT_EQ(BilinearPlanner(BilinearPlanner::DefaultSchemes(), {1e9}).Plan(512, 512, 512).nodes.size(), 1U);
+}
+#endif
+
+#define __ERROR_RESULT_TEST(N, M, L) \
+    TEST(ERROR_CLASS(CLASS_NAME), __##N##x##M##_dot_##M##x##L##_result) { \
+        Matrix<float> A(N, M); \
+        Matrix<float> B(M, L); \
+        Matrix<float> C(L, N); \
+        EXPECT_ANY_THROW(CLASS_NAME<float>::Mul(A, B, C)); \
+    }
+
 __ERROR_TEST(5, 5, 6, 6)
-__ERROR_TEST(5, 6, 6, 5)
-__ERROR_TEST(5, 6, 6, 7)
 __ERROR_TEST(5, 6, 7, 8)
 __ERROR_TEST(1, 2, 3, 4)
 __ERROR_TEST(1, 1, 1, 1)
 __ERROR_TEST(0, 0, 0, 0)
+__ERROR_TEST(5, 1, 1, 5)
+__ERROR_RESULT_TEST(5, 6, 7)
 
 
 
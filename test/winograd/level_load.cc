@@ -66,6 +66,9 @@ void F(const unsigned N, const unsigned repeat = 10) {
         std::cout << i.first << ":\t" << Time::GetAdapt(i.second.first) << "\t"
                     << Time::GetAdapt(i.second.second) << "\n\t\t";
     }
+    std::cout << "\n\tWorkspace: " << W::WorkspaceSize(N) * sizeof(T) / 1024 << " KiB, low memory "
+              << W::WorkspaceSize(N, N, N, 34, W::Schedule::LowMemory) * sizeof(T) / 1024
+              << " KiB\n";
     std::cout << "\n\n";
 }
 
@@ -50,37 +50,6 @@ void Mul2(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C)
     }
 }
 
-template<class T>
-void Mul2Parallel(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c)
-{
-    std::vector<std::thread> thrs;
-    const unsigned threads = 8;
-    const unsigned n = a.GetRows();
-    const T *A = a.Data();
-    const T *B = b.Data();
-    T *C = c.Data();
-
-    for (unsigned thc = 0; thc < threads; ++thc) {
-        thrs.emplace_back([&, thc](){
-            unsigned delta = n / threads;
-            unsigned end = (thc == threads - 1 ? n : (thc + 1) * delta);
-            for (unsigned i = thc * delta; i < end; ++i) {
-                for (unsigned k = 0; k < n; ++k)
-                {
-                    double r = A[i * n + k];
-                    for (unsigned j = 0; j < n; ++j)
-                    {
-                        C[i * n + j] += r * B[k * n + j];
-                    }
-                }
-            }
-        });
-    }
-    for (auto &i : thrs) {
-        i.join();
-    }
-}
-
 using type = double;
 
 void OneTest(const unsigned N)
@@ -94,7 +63,7 @@ void OneTest(const unsigned N)
 
     // MulBlas<type>(A, B, C);
     // Mul2<type>(A, B, C);
-    Mul2Parallel<type>(A, B, C);
+    Matrix<type>::Algebra::MulParallel(A, B, C);
 }
 
 int main()
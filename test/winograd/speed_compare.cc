@@ -4,6 +4,7 @@
 #include "strassen_winograd/strassen_parallel.h"
 #include "strassen_winograd/strassen.h"
 #include "../utility/utility.h"
+#include "../../matrix_algebra.h"
 
 #include "parser.h"
 
@@ -38,36 +39,6 @@ void MulBlas(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C)
               C.Data(), B.GetCols());
 }
 
-template<class T>
-void MulParallel(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c)
-{
-    std::vector<std::thread> thrs;
-    const unsigned threads = 8;
-    const unsigned n = a.GetRows();
-    const T *A = a.Data();
-    const T *B = b.Data();
-    T *C = c.Data();
-
-    for (unsigned thc = 0; thc < threads; ++thc) {
-        thrs.emplace_back([&, thc](){
-            unsigned delta = n / threads;
-            unsigned end = (thc == threads - 1 ? n : (thc + 1) * delta);
-            for (unsigned i = thc * delta; i < end; ++i) {
-                for (unsigned j = 0; j < n; ++j) {
-                    T sum = 0;
-                    for (unsigned l = 0; l < n; ++l) {
-                        sum += A[i * n + l] * B[l * n + j];
-                    }
-                    C[i * n + j] = sum;
-                }
-            }
-        });
-    }
-    for (auto &i : thrs) {
-        i.join();
-    }
-}
-
 template<class T>
 void Mul2(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C)
 {
@@ -88,37 +59,6 @@ void Mul2(const Matrix<T> &A, const Matrix<T> &B, Matrix<T> &C)
     }
 }
 
-template<class T>
-void Mul2Parallel(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c)
-{
-    std::vector<std::thread> thrs;
-    const unsigned threads = 8;
-    const unsigned n = a.GetRows();
-    const T *A = a.Data();
-    const T *B = b.Data();
-    T *C = c.Data();
-
-    for (unsigned thc = 0; thc < threads; ++thc) {
-        thrs.emplace_back([&, thc](){
-            unsigned delta = n / threads;
-            unsigned end = (thc == threads - 1 ? n : (thc + 1) * delta);
-            for (unsigned i = thc * delta; i < end; ++i) {
-                for (unsigned k = 0; k < n; ++k)
-                {
-                    double r = A[i * n + k];
-                    for (unsigned j = 0; j < n; ++j)
-                    {
-                        C[i * n + j] += r * B[k * n + j];
-                    }
-                }
-            }
-        });
-    }
-    for (auto &i : thrs) {
-        i.join();
-    }
-}
-
 template<class T, class Unit>
 std::vector<int64_t> All(const unsigned N, unsigned int repeat) {
     Matrix<T> A(N, N, Random::Easy<T>::R(static_cast<T>(-1000), static_cast<T>(1000)));
@@ -136,7 +76,9 @@ std::vector<int64_t> All(const unsigned N, unsigned int repeat) {
         }, [&] {
             MulBlas<T>(A, B, C);
         }, [&] {
-            Mul2Parallel(A, B, C);
+            Matrix<T>::Algebra::MulParallel(A, B, C);
+        }, [&] {
+            Matrix<T>::Algebra::Mul(A, B, C);
         }
     );
 }
@@ -169,6 +111,47 @@ void TestConf()
     Print<double>(4096, 1);
 }
 
+// Socket-level scaling of the parallel engines: one thread, the CPUs of
+// the first NUMA node, every CPU, first with NUMA mode off, then on
+template<class T>
+void NumaScaling(const unsigned N, unsigned repeat)
+{
+    Matrix<T> A(N, N, Random::Easy<T>::R(static_cast<T>(-1000), static_cast<T>(1000)));
+    Matrix<T> B(N, N, Random::Easy<T>::R(static_cast<T>(-1000), static_cast<T>(1000)));
+    Matrix<T> C(N, N);
+    const auto nodes = parallel::Nodes();
+    const unsigned socket = static_cast<unsigned>(nodes.front().second.size());
+    std::cout << N << ": " << nodes.size() << " nodes, " << parallel::AvailableThreads()
+              << " threads\n";
+    for (bool numa : {false, true})
+    {
+        parallel::SetNuma(numa);
+        // Plans keep the placement they were made with
+        WinogradP<T>::Plans().Clear();
+        StrassenP<T>::Plans().Clear();
+        for (unsigned threads : {1u, socket, parallel::AvailableThreads()})
+        {
+            parallel::ThreadBudget budget(threads);
+            auto r = Time::Compare<Time::ns>(repeat, [&] {
+                    WinogradP<T>::Mul(A, B, C);
+                }, [&] {
+                    StrassenP<T>::Mul(A, B, C);
+                }
+            );
+            std::cout << "\tnuma " << numa << ", " << threads << " threads: "
+                      << Time::GetAdapt<Time::ns>(r[0]) << ' '
+                      << Time::GetAdapt<Time::ns>(r[1]) << '\n';
+        }
+    }
+    parallel::SetNuma(false);
+}
+
+void NumaConf()
+{
+    NumaScaling<double>(2048, 3);
+    NumaScaling<double>(4096, 1);
+}
+
 
 void ToFileConf()
 {
@@ -255,7 +238,7 @@ void ToFileConf()
     std::cout << s.size() << '\n';
 
 
-    input_data result(7);
+    input_data result(8);
     for (auto &i : s)
     {
         unsigned repeat = 50000;
@@ -272,7 +255,7 @@ void ToFileConf()
             result[k + 1].push_back(r[k]);
         
 
-        std::cout << i << ": " << r[0] << ' ' << r[1] << ' ' << r[2] << ' ' << r[3] << ' ' << r[4] << ' ' << r[5] << '\n';
+        std::cout << i << ": " << r[0] << ' ' << r[1] << ' ' << r[2] << ' ' << r[3] << ' ' << r[4] << ' ' << r[5] << ' ' << r[6] << '\n';
     }
     Parser::ToFile("test8", result);
 
@@ -328,6 +311,7 @@ void ToFileConf()
 int main() {
 
     // TestConf();
+    // NumaConf();
     ToFileConf();
 
     return 0;
@@ -0,0 +1,129 @@
+#include "../utility/utility.h"
+#include "strassen_winograd/winograd_parallel.h"
+#include "strassen_winograd/strassen.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Measures the cut-over points of the recursive engines on this host and
+// writes them to the tuning profile the library reads at startup:
+//
+//   ./tune [profile path]      (default: tuning::ProfilePath())
+//
+// Every threshold is the first size from which one more recursive level
+// beats the level below it, for two sizes in a row. Thresholds depend on
+// the leaf, run it with the MAYKITBO_LEAF the programs will use.
+
+using namespace maykitbo;
+
+template<class F>
+int64_t Best(F f, int repeat = 3)
+{
+    int64_t best = -1;
+    for (int k = 0; k < repeat; ++k)
+    {
+        int64_t t = Time::Test<Time::mcs>(f);
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+// First size where wins(size) holds for it and the next one, or 0
+template<class W>
+unsigned Crossover(const std::vector<unsigned> &sizes, W wins)
+{
+    for (std::size_t i = 0; i + 1 < sizes.size(); ++i)
+    {
+        if (wins(sizes[i]) && wins(sizes[i + 1]))
+            return sizes[i];
+    }
+    return 0;
+}
+
+template<class T>
+struct Bench
+{
+    unsigned m, k, n;
+    Matrix<T> A, B, C;
+    Bench(unsigned m, unsigned k, unsigned n)
+        : m(m), k(k), n(n)
+        , A(m, k, [] { return Random::Easy<T>::R(-10, 10); })
+        , B(k, n, [] { return Random::Easy<T>::R(-10, 10); })
+        , C(m, n)
+    {}
+    template<class P>
+    int64_t Run(P &plan) { return Best([&] { plan.Execute(A, B, C); }); }
+};
+
+template<class T>
+Thresholds Tune()
+{
+    Thresholds t;
+    const std::vector<unsigned> even = {32, 48, 64, 96, 128, 160, 192, 256, 320, 384, 512};
+
+    unsigned w = Crossover(even, [](unsigned n)
+    {
+        Bench<T> b(n, n, n);
+        Winograd<T> leaf(n, n), level(n, n / 2 - 1);
+        return b.Run(level) < b.Run(leaf);
+    });
+    t.winograd_cap = w ? w - 2 : even.back();
+    t.winogradp_cap = t.winograd_cap;
+
+    unsigned s = Crossover(even, [](unsigned n)
+    {
+        Bench<T> b(n, n, n);
+        Strassen<T> leaf(n, n, n, 0, n + 1), level(n, n, n, 0, n);
+        return b.Run(level) < b.Run(leaf);
+    });
+    t.strassen_cap = s ? s : even.back() + 1;
+
+    std::vector<unsigned> odd;
+    for (unsigned n : even)
+        odd.push_back(n + 1);
+    unsigned o = Crossover(odd, [](unsigned n)
+    {
+        Bench<T> b(n, n, n);
+        Strassen<T> leaf(n, n, n, n, n + 2), level(n, n, n, 0, n + 1);
+        return b.Run(level) < b.Run(leaf);
+    });
+    t.odd_cap = o ? (o + 1) / 2 : odd.back();
+
+    const std::vector<unsigned> parallel = {160, 256, 384, 512, 768};
+    unsigned p = Crossover(parallel, [&t](unsigned n)
+    {
+        Bench<T> b(n, n, n);
+        Winograd<T> sequential(n, t.winograd_cap);
+        WinogradP<T> threaded(n, t.winograd_cap);
+        return b.Run(threaded) < b.Run(sequential);
+    });
+    t.parallel_min = p ? p - 1 : parallel.back();
+
+    std::cout << tuning::TypeName<T>() << ":\twinograd_cap " << t.winograd_cap
+              << "\tstrassen_cap " << t.strassen_cap << "\todd_cap " << t.odd_cap
+              << "\tparallel_min " << t.parallel_min << std::endl;
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    std::string path = (argc > 1 ? argv[1] : tuning::ProfilePath());
+    // Measure from the built-in defaults, not from an older profile
+    setenv("MAYKITBO_TUNING", "", 1);
+
+    std::cout << "leaf: " << LeafName(ActiveLeaf()) << '\n';
+    tuning::Profile profile;
+    profile[tuning::TypeName<float>()] = Tune<float>();
+    profile[tuning::TypeName<double>()] = Tune<double>();
+    profile[tuning::TypeName<int>()] = Tune<int>();
+
+    if (!tuning::Save(path, profile))
+    {
+        std::cerr << "cannot write " << path << '\n';
+        return 1;
+    }
+    std::cout << "profile written to " << path << '\n';
+    return 0;
+}